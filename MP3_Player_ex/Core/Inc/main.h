@@ -67,8 +67,10 @@ void Error_Handler(void);
 #define XRST_GPIO_Port GPIOC
 #define DREQ_Pin GPIO_PIN_3
 #define DREQ_GPIO_Port GPIOC
+#define DREQ_EXTI_IRQn EXTI3_IRQn
 
 /* USER CODE BEGIN Private defines */
+#define SD_USE_SPI_BUS 1 /* SD driver goes through spi_bus (spiBus1) */
 
 /* USER CODE END Private defines */
 
@@ -5,16 +5,58 @@
 #include "stm32f1xx_hal.h"
 #include "vs1053.h"
 
+#define MP3_READ_HIST_BINS 8 /* f_read latency, bin n: < 256us << n, last bin: the rest */
+
+typedef struct
+{
+    uint32_t underruns;     /* DREQ high while the ring was empty */
+    uint32_t refills;       /* f_read calls */
+    uint32_t lowWatermark;  /* lowest fill level seen by the DREQ side (bytes) */
+    uint32_t highWatermark; /* highest fill level after a refill (bytes) */
+    uint32_t sdiBytes;      /* bytes sent to VS1053 */
+    uint32_t stallCycles;   /* DREQ low while the ring had data (CPU cycles, DWT) */
+    uint32_t readMaxCycles; /* slowest f_read */
+    uint32_t idleCycles;    /* superloop passes with nothing to do, DREQ interrupt time taken out (CPU cycles) */
+    uint32_t readHist[MP3_READ_HIST_BINS];
+} MP3_BufferStats;
+
+#define MP3_PLAYLIST_SIZE 8
+#define MP3_PATH_LEN 64
+
+/* Plugin image on the SD card: the .plg array as little endian 16 bit words */
+#define MP3_PLUGIN_FILE "plugin.bin"
+
+typedef void (*MP3_StopCallback)(void);
+
 /* Functions */
 bool MP3_Init(void);
+bool MP3_LoadPluginFile(const char *filename);
 bool MP3_Play(const char *filename);
 void MP3_Stop(void);
+void MP3_StopAsync(MP3_StopCallback callback);
+bool MP3_IsStopping(void);
 void MP3_Pause(void);
 void MP3_Resume(void);
-void MP3_Feeder(void);
+bool MP3_Seek(uint32_t ms);
+uint32_t MP3_GetDurationMs(void);
+bool MP3_PlaylistAdd(const char *filename);
+uint8_t MP3_PlaylistAddDir(const char *path);
+void MP3_PlaylistClear(void);
+bool MP3_PlaylistPlay(void);
+bool MP3_Feeder(void);
+void MP3_IdleTick(bool busy);
+void MP3_DreqCallback(void);
+void MP3_GetBufferStats(MP3_BufferStats *out);
+void MP3_ResetBufferStats(void);
+void MP3_TakeBufferStats(MP3_BufferStats *out);
 
 /* Flags */
 extern bool isPlaying;
 extern bool isFileOpen;
 
+/* Statistics */
+extern volatile uint32_t mp3RingFullPolls; /* Feeder calls that found the ring full, a count, not idle time */
+extern uint32_t mp3BootMs;                 /* MP3_Init until ready to play */
+extern uint32_t mp3PluginMs;               /* part of it spent on the plugin file */
+
 #endif /* MP3_PLAYER_H_ */
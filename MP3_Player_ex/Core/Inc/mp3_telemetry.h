@@ -0,0 +1,48 @@
+#ifndef MP3_TELEMETRY_H_
+#define MP3_TELEMETRY_H_
+
+#include <stdbool.h>
+#include "stm32f1xx_hal.h"
+#include "mp3_player.h"
+
+#define MP3_TLM_PERIOD_MS 1000
+#define MP3_TLM_TX_TIMEOUT_MS 100 /* MP3_TelemetryPrint: wait for a frame in flight, then send */
+
+/*
+ * Stats frame on USART2, little endian, sent every MP3_TLM_PERIOD_MS.
+ * Counters cover the period since the previous frame (the stats are reset
+ * after each frame). Decoded by uart_tools/mp3_telemetry.py.
+ */
+typedef struct __attribute__((packed))
+{
+    uint8_t sync[2];          /* 0x55 0xAA */
+    uint8_t type[2];          /* 'T' '1' */
+    uint16_t len;             /* bytes from tick to checksum */
+    uint32_t tick;            /* HAL_GetTick() */
+    uint16_t periodMs;
+    uint16_t hdat0;           /* MP3: bitrate / sample rate indexes */
+    uint16_t hdat1;           /* format: 0xFFE0+ MP3, "fL" FLAC, "Og" Ogg, "ve" WAV ... */
+    uint16_t decodeTime;      /* seconds */
+    uint16_t sampleRate;      /* AUDATA, Hz */
+    uint16_t bitrateKbps;     /* byteRate * 8 / 1000 */
+    uint32_t sdiBytesPerSec;
+    uint32_t underruns;
+    uint32_t refills;
+    uint32_t stallUs;         /* DREQ low while the ring had data */
+    uint32_t sciWaitUs;       /* busy waiting for DREQ around SCI frames */
+    uint16_t idlePermille;    /* superloop passes with nothing to do, per mille of the period */
+    uint16_t ringLow;         /* fill level watermarks, bytes */
+    uint16_t ringHigh;
+    uint32_t readMaxUs;
+    uint16_t readHist[MP3_READ_HIST_BINS]; /* f_read latency, bin n: < 256us << n */
+    uint8_t checksum;         /* sum of the bytes from tick */
+} MP3_TelemetryFrame;
+
+/* Functions */
+void MP3_TelemetryInit(void);
+void MP3_TelemetryEnable(bool enable);
+bool MP3_TelemetryIsEnabled(void);
+bool MP3_TelemetryTick(void);
+bool MP3_TelemetryPrint(const char *text, uint16_t len);
+
+#endif /* MP3_TELEMETRY_H_ */
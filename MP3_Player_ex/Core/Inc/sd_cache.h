@@ -0,0 +1,36 @@
+#ifndef _SD_CACHE_H_
+#define _SD_CACHE_H_
+
+#include <stdbool.h>
+
+#include "diskio.h"
+#include "ff.h"
+
+/**
+ * user_diskio.c와 fatfs_sd.c 사이의 write-back 섹터 캐시.
+ * 1섹터 단위의 쓰기(FAT, 디렉터리 엔트리 등 메타데이터)는 캐시에만 기록해
+ * 두었다가 CTRL_SYNC나 교체(eviction) 시 연속된 섹터끼리 묶어 CMD25로 쓴다.
+ * 여러 섹터를 한 번에 읽고 쓰는 요청(파일 데이터)은 캐시를 거치지 않는다.
+ */
+
+#define SD_CACHE_ENTRIES 4 /* 엔트리 하나당 512바이트 RAM 사용 */
+#define SD_CACHE_SECTOR_SIZE 512
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+    uint32_t flushes;         /* 캐시 flush 시 보낸 쓰기 명령 수 */
+    uint32_t flushed_sectors; /* flush로 카드에 쓴 섹터 수 */
+} SD_Cache_Stats;
+
+void    SD_Cache_Init();
+DRESULT SD_Cache_Read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count);
+DRESULT SD_Cache_Write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count);
+DRESULT SD_Cache_Sync(BYTE pdrv);
+DRESULT SD_Cache_ioctl(BYTE pdrv, BYTE cmd, void *buff);
+
+void SD_Cache_GetStats(SD_Cache_Stats *stats);
+void SD_Cache_ResetStats();
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _SD_PREFETCH_H_
+#define _SD_PREFETCH_H_
+
+#include <stdbool.h>
+
+#include "diskio.h"
+#include "ff.h"
+
+/**
+ * 연속된 섹터를 1섹터씩 읽는 패턴(f_read로 파일을 조금씩 스트리밍)을 감지하면
+ * 다음 섹터들을 CMD18로 한 번에 미리 읽어두는 read-ahead 단계.
+ * 미리 읽은 섹터를 모두 소비하면 다음 구간은 비동기(SD_ReadAsync)로 채우므로,
+ * SD_PollAsync를 슈퍼루프에서 호출하면 카드 대기 시간을 다른 작업과 겹칠 수
+ * 있다.
+ * 연속이 아닌 읽기가 오면 미리 읽은 구간을 버리고 새로 감지한다. 단,
+ * SD_Prefetch_SetMetaWindow로 알려준 FAT 영역의 읽기는 스트림을 끊지 않는다.
+ */
+
+#define SD_PREFETCH_DEPTH 4 /* 미리 읽을 섹터 수(섹터당 512바이트 RAM 사용) */
+#define SD_PREFETCH_SECTOR_SIZE 512
+
+typedef struct {
+    uint32_t depth;
+    uint32_t hits;       /* 미리 읽은 섹터로 처리한 읽기 */
+    uint32_t misses;     /* 연속 읽기였지만 미리 읽어둔 섹터가 없던 경우 */
+    uint32_t prefetched; /* 미리 읽은 섹터 수 */
+    uint32_t wasted;     /* 미리 읽었지만 쓰이지 않고 버려진 섹터 수 */
+} SD_Prefetch_Stats;
+
+void SD_Prefetch_Init();
+bool SD_Prefetch_Read(BYTE pdrv, BYTE *buff, DWORD sector, DRESULT *res);
+void SD_Prefetch_Invalidate(DWORD sector, UINT count);
+void SD_Prefetch_SetMetaWindow(DWORD first, DWORD count);
+
+void SD_Prefetch_GetStats(SD_Prefetch_Stats *stats);
+void SD_Prefetch_ResetStats();
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef SPI_BUS_H_
+#define SPI_BUS_H_
+
+#include <stdbool.h>
+#include "stm32f1xx_hal.h"
+
+/* A grant not taken up within this time is dropped (e.g. playback stopped meanwhile) */
+#define SPI_BUS_RESERVE_US 20
+
+/* Lower value wins the bus first */
+typedef enum
+{
+    SPI_BUS_PRIO_AUDIO,   /* VS1053 SDI chunks, the decoder must not run dry */
+    SPI_BUS_PRIO_CONTROL, /* VS1053 SCI registers */
+    SPI_BUS_PRIO_BULK,    /* SD card sectors */
+    SPI_BUS_PRIO_COUNT,
+} SPI_BusPriority;
+
+typedef struct SPI_BusDevice
+{
+    GPIO_TypeDef *csPort; /* NULL: the driver toggles CS itself (SCI frames need XCS high in between) */
+    uint16_t csPin;
+    uint32_t prescaler;   /* SPI_BAUDRATEPRESCALER_x */
+    uint32_t polarity;    /* SPI_POLARITY_x */
+    uint32_t phase;       /* SPI_PHASE_x */
+    SPI_BusPriority priority;
+    void (*grant)(void);  /* called when the bus is handed over after a failed try, may run in an interrupt */
+    void (*poll)(void);   /* called by waiters while this device owns the bus */
+    struct SPI_BusDevice *next; /* wait queue link */
+    bool queued;
+} SPI_BusDevice;
+
+typedef struct
+{
+    uint32_t acquires;
+    uint32_t contentions;     /* tries that found the bus taken or reserved */
+    uint32_t switches;        /* CR1 reprogrammed for another device */
+    uint32_t switchCycles;    /* total cost of those switches (DWT) */
+    uint32_t maxSwitchCycles;
+    uint32_t grants[SPI_BUS_PRIO_COUNT];
+} SPI_BusStats;
+
+typedef struct
+{
+    SPI_HandleTypeDef *hspi;
+    SPI_BusDevice *volatile owner;
+    SPI_BusDevice *volatile reserved; /* next in line after a release, others must not take the bus */
+    uint32_t reservedAt;              /* CYCCNT of the release */
+    SPI_BusDevice *config;            /* device whose settings are in CR1 */
+    SPI_BusDevice *queue[SPI_BUS_PRIO_COUNT];
+    SPI_BusStats stats;
+} SPI_Bus;
+
+extern SPI_Bus spiBus1; /* SD card (and VS1053 on single-bus boards) */
+extern SPI_Bus spiBus2; /* VS1053 */
+
+/* Functions */
+void SPI_Bus_Init(SPI_Bus *bus, SPI_HandleTypeDef *hspi);
+bool SPI_Bus_TryAcquire(SPI_Bus *bus, SPI_BusDevice *dev);
+void SPI_Bus_Acquire(SPI_Bus *bus, SPI_BusDevice *dev);
+void SPI_Bus_Release(SPI_Bus *bus, SPI_BusDevice *dev);
+bool SPI_Bus_HasWaiter(SPI_Bus *bus, SPI_BusPriority than);
+bool SPI_Bus_IsOwner(SPI_Bus *bus, SPI_BusDevice *dev);
+void SPI_Bus_SetPrescaler(SPI_Bus *bus, SPI_BusDevice *dev, uint32_t prescaler);
+void SPI_Bus_GetStats(SPI_Bus *bus, SPI_BusStats *out);
+void SPI_Bus_ResetStats(SPI_Bus *bus);
+bool SPI_Bus_Benchmark(SPI_Bus *bus, SPI_BusDevice *a, SPI_BusDevice *b, uint16_t rounds,
+                       uint32_t *directCycles, uint32_t *halInitCycles);
+
+#endif /* SPI_BUS_H_ */
@@ -5,12 +5,30 @@
 
 #include <stdbool.h>
 #include "stm32f1xx_hal.h"
+#include "spi_bus.h"
+
+/*
+ * 1: VS1053 shares SPI1 with the SD card (single-bus boards), 0: own SPI2.
+ * Shared: SDI needs hdma_spi1_tx, and EXTI3 must have the same NVIC priority
+ * as the SPI1 DMA channels so MP3_DreqCallback never preempts itself.
+ */
+#define VS1053_SHARED_SPI			0
 
 /* Pin configuration */
+#if VS1053_SHARED_SPI
+extern SPI_HandleTypeDef 			hspi1;
+#define HSPI_VS1053					&hspi1
+#define VS1053_BUS					(&spiBus1)
+#else
 extern SPI_HandleTypeDef 			hspi2;
 #define HSPI_VS1053					&hspi2
+#define VS1053_BUS					(&spiBus2)
+#endif
 #define VS1053_DREQ_PORT			GPIOC
 #define VS1053_DREQ_PIN				GPIO_PIN_3
+
+/* 1: SDI chunks go out on TX DMA (hdma_spi2_tx / hdma_spi1_tx), 0: blocking HAL transfer */
+#define VS1053_USE_DMA				1
 #define	VS1053_XRST_PORT			GPIOC
 #define	VS1053_XRST_PIN				GPIO_PIN_2
 #define VS1053_XCS_PORT				GPIOC
@@ -18,6 +36,55 @@ extern SPI_HandleTypeDef 			hspi2;
 #define VS1053_XDCS_PORT			GPIOC
 #define VS1053_XDCS_PIN				GPIO_PIN_0
 
+/* 1: VS1053_Init loads vs1053Plugin[] (VLSI .plg array linked into flash) */
+#define VS1053_PLUGIN_FLASH			0
+
+/* Registers (defined in vs1053.c) */
+extern const uint8_t VS1053_REG_MODE;
+extern const uint8_t VS1053_REG_DECODE_TIME;
+extern const uint8_t VS1053_REG_WRAM;
+extern const uint8_t VS1053_REG_WRAMADDR;
+extern const uint8_t VS1053_REG_VOL;
+extern const uint8_t VS1053_REG_AUDATA;
+extern const uint8_t VS1053_REG_HDAT0;
+extern const uint8_t VS1053_REG_HDAT1;
+
+/* One register write of a VS1053_SciBatch() sequence */
+typedef struct
+{
+    uint8_t address;
+    uint16_t value;
+} VS1053_SciOp;
+
+typedef struct
+{
+    uint32_t writes;         /* SCI write frames sent */
+    uint32_t reads;          /* SCI read frames sent */
+    uint32_t skippedWrites;  /* writes dropped because the shadow already matched */
+    uint32_t batches;        /* VS1053_SciBatch() calls */
+    uint32_t savedDreqWaits; /* DREQ waits saved by batching */
+    uint32_t dreqWaitCycles; /* CPU cycles spent waiting for DREQ around SCI frames */
+} VS1053_SciStats;
+
+/*
+ * Streaming parser for the VLSI compressed plugin format, a list of 16 bit words:
+ *   addr, n, n words          (n < 0x8000: copy)
+ *   addr, 0x8000 | n, 1 word  (RLE: the word is written n times)
+ * Every word goes to SCI register addr, usually WRAMADDR then WRAM.
+ */
+typedef struct
+{
+    uint8_t state;  /* next word is: 0 address, 1 count, 2 data */
+    uint8_t addr;
+    uint16_t count; /* data writes left in the record */
+    bool rle;
+    uint32_t words; /* SCI writes done */
+} VS1053_PluginParser;
+
+#if VS1053_PLUGIN_FLASH
+extern const uint16_t vs1053Plugin[];
+extern const uint32_t vs1053PluginSize; /* in words */
+#endif
 
 /* Functions */
 bool VS1053_Init();
@@ -29,11 +96,24 @@ bool VS1053_GetMode(uint16_t *mode);
 bool VS1053_AutoResync();
 bool VS1053_SetDecodeTime(uint16_t time);
 bool VS1053_SendEndFill(uint16_t num);
+bool VS1053_LoadEndFill();
+bool VS1053_SendEndFillChunk();
 bool VS1053_IsBusy();
 bool VS1053_SciWrite(uint8_t address, uint16_t input);
 bool VS1053_SciRead(uint8_t address, uint16_t *res);
+bool VS1053_SciBatch(const VS1053_SciOp *ops, uint8_t count);
+void VS1053_GetSciStats(VS1053_SciStats *out);
+void VS1053_ResetSciStats();
+void VS1053_PluginBegin(VS1053_PluginParser *parser);
+bool VS1053_PluginFeed(VS1053_PluginParser *parser, const uint16_t *words, uint32_t count);
+bool VS1053_PluginEnd(VS1053_PluginParser *parser);
+bool VS1053_LoadPlugin(const uint16_t *plugin, uint32_t count);
+bool VS1053_LoadPatches();
 bool VS1053_SdiWrite(uint8_t input);
 bool VS1053_SdiWrite32(uint8_t *input32);
+bool VS1053_SdiStart(uint8_t *input, uint16_t len);
+bool VS1053_SdiIsBusy(void);
+void VS1053_SdiDmaCpltCallback(void);
 
 extern uint8_t endFillByte;
 
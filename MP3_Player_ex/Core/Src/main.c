@@ -24,6 +24,10 @@
 /* USER CODE BEGIN Includes */
 #include "stm32f1xx_hal.h"
 #include "mp3_player.h"
+#include "mp3_telemetry.h"
+#include "spi_bus.h"
+#include "fatfs_sd.h"
+#include <stdio.h>
 
 
 /* USER CODE END Includes */
@@ -46,6 +50,9 @@
 /* Private variables ---------------------------------------------------------*/
 SPI_HandleTypeDef hspi1;
 SPI_HandleTypeDef hspi2;
+DMA_HandleTypeDef hdma_spi1_rx;
+DMA_HandleTypeDef hdma_spi1_tx;
+DMA_HandleTypeDef hdma_spi2_tx;
 
 UART_HandleTypeDef huart2;
 
@@ -58,6 +65,7 @@ uint8_t SerialCmd = 0;
 /* Private function prototypes -----------------------------------------------*/
 void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
+static void MX_DMA_Init(void);
 static void MX_SPI1_Init(void);
 static void MX_SPI2_Init(void);
 static void MX_USART2_UART_Init(void);
@@ -76,6 +84,63 @@ void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
   }
 }
 
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+{
+  if (GPIO_Pin == DREQ_Pin)
+  {
+    MP3_DreqCallback();
+  }
+}
+
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+  /* With VS1053_SHARED_SPI both devices complete on SPI1, SDI is checked first */
+  if (hspi == HSPI_VS1053 && VS1053_SdiIsBusy())
+  {
+    VS1053_SdiDmaCpltCallback();
+    MP3_DreqCallback(); /* send the next chunk while DREQ is high */
+  }
+  else if (hspi->Instance == SPI1)
+  {
+    SD_SPI_DMA_CpltCallback();
+  }
+}
+
+/* Device switch cost on the VS1053 bus: CR1 writes against HAL_SPI_Init */
+static void SPI_BusBenchmarkReport(void)
+{
+  static SPI_BusDevice slow = {
+    .prescaler = SPI_BAUDRATEPRESCALER_256,
+    .polarity = SPI_POLARITY_LOW,
+    .phase = SPI_PHASE_1EDGE,
+    .priority = SPI_BUS_PRIO_BULK,
+  };
+  static SPI_BusDevice fast = {
+    .prescaler = SPI_BAUDRATEPRESCALER_16,
+    .polarity = SPI_POLARITY_LOW,
+    .phase = SPI_PHASE_1EDGE,
+    .priority = SPI_BUS_PRIO_BULK,
+  };
+  uint32_t direct, halInit;
+  char msg[64];
+  int len;
+
+  if (SPI_Bus_Benchmark(VS1053_BUS, &fast, &slow, 100, &direct, &halInit))
+    len = snprintf(msg, sizeof(msg), "spi switch %lu cycles, HAL_SPI_Init %lu cycles\r\n",
+                   (unsigned long)direct, (unsigned long)halInit);
+  else
+    len = snprintf(msg, sizeof(msg), "spi bus busy\r\n");
+  MP3_TelemetryPrint(msg, len);
+}
+
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+  if (hspi->Instance == SPI1)
+  {
+    SD_SPI_DMA_CpltCallback();
+  }
+}
+
 /* USER CODE END 0 */
 
 /**
@@ -107,11 +172,15 @@ int main(void)
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  MX_DMA_Init();
   MX_SPI1_Init();
   MX_SPI2_Init();
   MX_USART2_UART_Init();
   MX_FATFS_Init();
   /* USER CODE BEGIN 2 */
+  MP3_TelemetryInit();
+  SPI_Bus_Init(&spiBus1, &hspi1);
+  SPI_Bus_Init(&spiBus2, &hspi2);
   if (!MP3_Init())
   {
     HAL_GPIO_WritePin(GPIOD, GPIO_PIN_14, GPIO_PIN_SET);
@@ -119,6 +188,12 @@ int main(void)
   else
   {
     HAL_GPIO_WritePin(GPIOD, GPIO_PIN_12, GPIO_PIN_SET);
+
+    /* Report time to ready to play */
+    char msg[48];
+    int len = snprintf(msg, sizeof(msg), "boot %lu ms (plugin %lu ms)\r\n",
+                       (unsigned long)mp3BootMs, (unsigned long)mp3PluginMs);
+    MP3_TelemetryPrint(msg, len);
   }
   HAL_UART_Receive_IT(&huart2, &SerialCmd, 1);
 
@@ -131,6 +206,8 @@ int main(void)
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
+    bool busy = SerialFlag != 0;
+
     if (SerialFlag)
     {
       SerialFlag = 0;
@@ -143,6 +220,12 @@ int main(void)
       case '2':
         MP3_Play("sonata14-1.mp3");
         break;
+      case 'l':
+      case 'L':
+        MP3_PlaylistClear();
+        MP3_PlaylistAddDir("");
+        MP3_PlaylistPlay();
+        break;
       case 'p':
       case 'P':
         isPlaying = !isPlaying;
@@ -151,12 +234,22 @@ int main(void)
       case 'S':
         MP3_Stop();
         break;
+      case 'b':
+      case 'B':
+        SPI_BusBenchmarkReport();
+        break;
+      case 't':
+      case 'T':
+        MP3_TelemetryEnable(!MP3_TelemetryIsEnabled());
+        break;
       default:
         break;
       }
     }
 
-    MP3_Feeder();
+    busy |= MP3_Feeder();
+    busy |= MP3_TelemetryTick();
+    MP3_IdleTick(busy); /* idle time for the telemetry frame */
   }
   /* USER CODE END 3 */
 }
@@ -308,6 +401,28 @@ static void MX_USART2_UART_Init(void)
 
 }
 
+/**
+  * Enable DMA controller clock
+  */
+static void MX_DMA_Init(void)
+{
+
+  /* DMA controller clock enable */
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  /* DMA interrupt init */
+  /* DMA1_Channel2_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel2_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel2_IRQn);
+  /* DMA1_Channel3_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel3_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel3_IRQn);
+  /* DMA1_Channel5_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel5_IRQn, 1, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel5_IRQn);
+
+}
+
 /**
   * @brief GPIO Initialization Function
   * @param None
@@ -348,13 +463,17 @@ static void MX_GPIO_Init(void)
 
   /*Configure GPIO pin : DREQ_Pin */
   GPIO_InitStruct.Pin = DREQ_Pin;
-  GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;
   GPIO_InitStruct.Pull = GPIO_PULLUP;
   HAL_GPIO_Init(DREQ_GPIO_Port, &GPIO_InitStruct);
 
   /*Configure peripheral I/O remapping */
   __HAL_AFIO_REMAP_PD01_ENABLE();
 
+  /* EXTI interrupt init*/
+  HAL_NVIC_SetPriority(EXTI3_IRQn, 1, 0);
+  HAL_NVIC_EnableIRQ(EXTI3_IRQn);
+
   /* USER CODE BEGIN MX_GPIO_Init_2 */
 
   /* USER CODE END MX_GPIO_Init_2 */
@@ -1,23 +1,110 @@
 #include "mp3_player.h"
 #include "fatfs_sd.h"
+#include "sd_prefetch.h"
+#include <string.h>
 
-#define BUFFER_SIZE 32
+#define BUFFER_SIZE 32  /* SDI chunk, VS1053 takes 32 bytes per DREQ */
+#define SECTOR_SIZE 512
+#define RING_SECTORS 4  /* 2, 4 or 8 */
+#define RING_SIZE (RING_SECTORS * SECTOR_SIZE)
+#define RING_MASK (RING_SIZE - 1)
 
 uint8_t mp3Buffer[BUFFER_SIZE];
 uint32_t mp3FileSize;
 uint32_t readBytes;
-uint16_t cnt = 0;
+
+/* Filled by MP3_Feeder, drained by the DREQ interrupt */
+static uint8_t mp3Ring[RING_SIZE];
+static volatile uint32_t ringHead;
+static volatile uint32_t ringTail;
+static volatile uint32_t sdiLen; /* bytes of the chunk in flight */
+static volatile bool endOfFile;
+static bool starved;
+
+static MP3_BufferStats bufStats;
+static uint32_t stallStart; /* CYCCNT when DREQ went low with data waiting */
+static bool dreqStalled;
+static volatile uint32_t dreqCycles; /* time spent in MP3_DreqCallback, never reset */
+static uint32_t passStart;           /* CYCCNT and dreqCycles at the start of the superloop pass */
+static uint32_t passDreq;
+
+/* Cluster link map table for O(1) f_lseek, 32 fragments */
+#define CLMT_SIZE 66
+static DWORD clmt[CLMT_SIZE];
+
+/* Stream info parsed when a track is opened, used by MP3_Seek */
+typedef struct
+{
+    uint32_t audioStart;  /* first frame offset (after ID3v2 tag) */
+    uint32_t audioBytes;  /* bytes of audio frames */
+    uint32_t durationMs;
+    uint32_t bitrateKbps; /* header bitrate (CBR) or average (VBR) */
+    uint8_t xingToc[100]; /* Xing seek table, offset = toc[percent] / 256 */
+    bool hasToc;
+} MP3_StreamInfo;
+
+static MP3_StreamInfo info; /* track the decoder is playing */
+
+/* Next playlist track, opened while the ring still holds the tail of the current one */
+static MP3_StreamInfo nextInfo;
+static bool nextPending;
+static uint32_t nextStart; /* ringHead where the next track begins */
+
+static const uint16_t bitrateTable[2][16] = {
+    {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0}, /* MPEG1 Layer III */
+    {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0},     /* MPEG2/2.5 Layer III */
+};
+static const uint16_t sampleRateTable[3] = {44100, 48000, 32000};
+
+/* Scratch for MP3_ParseStreamInfo, the ring may still hold the previous track */
+static uint8_t infoBuffer[256] __attribute__((aligned(4)));
+
+/* Playlist: tracks after the current one are opened as soon as it is fully read */
+static char playlist[MP3_PLAYLIST_SIZE][MP3_PATH_LEN];
+static uint8_t playlistCount;
+static uint8_t playlistNext;
+
+/* Cancel sequence, advanced one 32 byte chunk per MP3_Feeder call */
+typedef enum
+{
+    STOP_IDLE,
+    STOP_ENDFILL, /* 2052 endFill bytes to flush the decoder */
+    STOP_CANCEL,  /* SM_CANCEL set, endFill until the decoder clears it */
+} MP3_StopState;
+
+static MP3_StopState stopState = STOP_IDLE;
+static uint16_t stopBytes;
+static MP3_StopCallback stopCallback;
+static char pendingTrack[MP3_PATH_LEN]; /* started when the cancel finishes */
+static bool pluginLost;                 /* soft reset during a cancel, reload patches */
+
+static bool MP3_Start(const char *filename);
+static void MP3_StopTick(void);
+static void MP3_StopFinish(void);
+static bool MP3_OpenFile(const char *filename, MP3_StreamInfo *out);
+static bool MP3_OpenNext(void);
+static void MP3_ParseStreamInfo(MP3_StreamInfo *out);
+static uint32_t MP3_ReadBE32(const uint8_t *p);
+static void MP3_RecordReadLatency(uint32_t cycles);
+static void MP3_DreqService(void);
 
 bool isPlaying = false;
 bool isFileOpen = false;
 
+volatile uint32_t mp3RingFullPolls;
+uint32_t mp3BootMs;
+uint32_t mp3PluginMs;
+
 FATFS fs;
 FIL mp3File;
 
 /* Initialize VS1053 & Open a file */
 bool MP3_Init()
 {
-    /* Initialize VS1053 */
+    uint32_t start = HAL_GetTick();
+    uint32_t pluginStart;
+
+    /* Initialize VS1053, patches in flash are loaded here */
     if (!VS1053_Init())
         return false;
 
@@ -25,29 +112,94 @@ bool MP3_Init()
     if (f_mount(&fs, "", 0) != FR_OK)
         return false;
 
+    /* Plugin from the SD card, optional */
+    pluginStart = HAL_GetTick();
+    if (!MP3_LoadPluginFile(MP3_PLUGIN_FILE))
+        return false;
+    mp3PluginMs = HAL_GetTick() - pluginStart;
+
+    /* The volume is mounted now, FAT lookups between clusters keep the read-ahead */
+    SD_Prefetch_SetMetaWindow(fs.fatbase, fs.database - fs.fatbase);
+
+    MP3_ResetBufferStats();
+    passStart = DWT->CYCCNT;
+
+    mp3BootMs = HAL_GetTick() - start;
     return true;
 }
 
+/* Stream a plugin image from the SD card into VS1053, a missing file is not an error */
+bool MP3_LoadPluginFile(const char *filename)
+{
+    VS1053_PluginParser parser;
+    FRESULT res;
+    UINT br;
+    bool ok;
+
+    /* Only called with no track open, borrow its FIL and the info scratch */
+    if (isFileOpen)
+        return false;
+
+    res = f_open(&mp3File, filename, FA_READ);
+    if (res == FR_NO_FILE)
+        return true;
+    if (res != FR_OK)
+        return false;
+
+    VS1053_PluginBegin(&parser);
+    do
+    {
+        ok = f_read(&mp3File, infoBuffer, sizeof(infoBuffer), &br) == FR_OK && (br & 1) == 0;
+        if (ok)
+            ok = VS1053_PluginFeed(&parser, (const uint16_t *)infoBuffer, br / 2);
+    } while (ok && br == sizeof(infoBuffer));
+    f_close(&mp3File);
+
+    /* Send what is still queued, an image cut inside a record fails */
+    if (!VS1053_PluginEnd(&parser))
+        return false;
+    return ok;
+}
+
 bool MP3_Play(const char *filename)
 {
-    if (isPlaying)
+    /* A single track does not continue into the queue */
+    playlistNext = playlistCount;
+    return MP3_Start(filename);
+}
+
+static bool MP3_Start(const char *filename)
+{
+    /* Let the current track cancel first, the new one starts when it is done */
+    if (isFileOpen || stopState != STOP_IDLE)
+    {
+        if (strlen(filename) >= MP3_PATH_LEN)
+            return false;
+        strcpy(pendingTrack, filename);
         MP3_Stop();
+        return true;
+    }
 
-    if (!VS1053_SetMode(0x4800))
-        return false; /* SM LINE1 | SM SDINEW */
-    if (!VS1053_AutoResync())
-        return false; /* AutoResync */
-    if (!VS1053_SetDecodeTime(0))
-        return false; /* Set decode time */
-    if (!VS1053_SetVolume(0x3F, 0x3F))
-        return false; /* Small number is louder */
+    /* Track setup in one SCI pass, MODE/VOL are skipped when unchanged */
+    const VS1053_SciOp startOps[] = {
+        {VS1053_REG_MODE, 0x4800},        /* SM LINE1 | SM SDINEW */
+        {VS1053_REG_WRAMADDR, 0x1E29},    /* AutoResync */
+        {VS1053_REG_WRAM, 0},
+        {VS1053_REG_DECODE_TIME, 0},      /* Set decode time, written twice */
+        {VS1053_REG_DECODE_TIME, 0},
+        {VS1053_REG_VOL, 0x3F3F},         /* Small number is louder */
+    };
+    if (!VS1053_SciBatch(startOps, sizeof(startOps) / sizeof(startOps[0])))
+        return false;
 
     /* Open file to read */
-    if (f_open(&mp3File, filename, FA_READ) != FR_OK)
+    if (!MP3_OpenFile(filename, &info))
         return false;
 
-    /* Get the file size */
-    mp3FileSize = f_size(&mp3File);
+    ringHead = ringTail = sdiLen = 0;
+    endOfFile = false;
+    starved = false;
+    nextPending = false;
 
     /* Set flags */
     isFileOpen = true;
@@ -55,24 +207,223 @@ bool MP3_Play(const char *filename)
 
     return true;
 }
+
+/* Open a track, build its link map and read its stream info into out */
+static bool MP3_OpenFile(const char *filename, MP3_StreamInfo *out)
+{
+    if (f_open(&mp3File, filename, FA_READ) != FR_OK)
+        return false;
+
+#if _USE_FASTSEEK
+    /* Build the cluster link map so seeking does not walk the FAT chain */
+    mp3File.cltbl = clmt;
+    clmt[0] = CLMT_SIZE;
+    if (f_lseek(&mp3File, CREATE_LINKMAP) != FR_OK)
+        mp3File.cltbl = NULL; /* Too fragmented, fall back to normal seek */
+#endif
+
+    MP3_ParseStreamInfo(out);
+
+    /* Get the file size */
+    mp3FileSize = f_size(&mp3File);
+    return true;
+}
+
+/*
+ * Current track is fully read: open the next queued one and keep filling the
+ * ring right behind it. The decoder plays the frames back-to-back, so there is
+ * no cancel/endfill/reset cycle between tracks. Its stream info is kept aside
+ * until the ring has drained up to nextStart.
+ */
+static bool MP3_OpenNext(void)
+{
+    /* A track shorter than the ring, wait for the one before it to be swapped in */
+    if (nextPending)
+        return playlistNext < playlistCount;
+
+    while (playlistNext < playlistCount)
+    {
+        f_close(&mp3File);
+        if (MP3_OpenFile(playlist[playlistNext++], &nextInfo))
+        {
+            nextStart = ringHead;
+            nextPending = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool MP3_PlaylistAdd(const char *filename)
+{
+    if (playlistCount >= MP3_PLAYLIST_SIZE || strlen(filename) >= MP3_PATH_LEN)
+        return false;
+
+    strcpy(playlist[playlistCount++], filename);
+    return true;
+}
+
+/* Queue every .mp3 file in a directory, returns the number of tracks added */
+uint8_t MP3_PlaylistAddDir(const char *path)
+{
+    static FILINFO fno;
+    DIR dir;
+    size_t len;
+    uint8_t added = 0;
+    char name[MP3_PATH_LEN];
+
+    if (f_opendir(&dir, path) != FR_OK)
+        return 0;
+
+    while (f_readdir(&dir, &fno) == FR_OK && fno.fname[0] != 0)
+    {
+        if (fno.fattrib & AM_DIR)
+            continue;
+
+        len = strlen(fno.fname);
+        if (len < 4 || (strcmp(&fno.fname[len - 4], ".mp3") != 0 &&
+                        strcmp(&fno.fname[len - 4], ".MP3") != 0))
+            continue;
+
+        if (strlen(path) + 1 + len >= MP3_PATH_LEN)
+            continue;
+        strcpy(name, path);
+        strcat(name, "/");
+        strcat(name, fno.fname);
+        if (!MP3_PlaylistAdd(name))
+            break;
+        added++;
+    }
+    f_closedir(&dir);
+    return added;
+}
+
+void MP3_PlaylistClear(void)
+{
+    playlistCount = 0;
+    playlistNext = 0;
+}
+
+/* Play the queue from the first track */
+bool MP3_PlaylistPlay(void)
+{
+    playlistNext = 0;
+    while (playlistNext < playlistCount)
+    {
+        if (MP3_Start(playlist[playlistNext++]))
+            return true;
+    }
+    return false;
+}
 void MP3_Stop(void)
 {
-    /* Refer to page 49 of VS1053 datasheet */
+    MP3_StopAsync(NULL);
+}
+
+/*
+ * Start the cancel sequence and return at once. MP3_Feeder drives it and
+ * callback (may be NULL) is called when the decoder is idle and the file is
+ * closed.
+ */
+void MP3_StopAsync(MP3_StopCallback callback)
+{
+    if (stopState != STOP_IDLE)
+    {
+        if (callback != NULL)
+            stopCallback = callback;
+        return;
+    }
+
+    stopCallback = callback;
+    isPlaying = false; /* DREQ interrupt stops feeding */
+
+    if (!isFileOpen)
+    {
+        MP3_StopFinish();
+        return;
+    }
+
+    VS1053_LoadEndFill();
+    stopBytes = 0;
+    stopState = STOP_ENDFILL;
+}
+
+bool MP3_IsStopping(void)
+{
+    return stopState != STOP_IDLE;
+}
 
+/* Refer to page 49 of VS1053 datasheet */
+static void MP3_StopTick(void)
+{
     uint16_t mode;
-    VS1053_SendEndFill(2052); /* send endfill bytes */
-    VS1053_SetMode(0x4808);   /* SM LINE1 | SM SDINEW | SM CANCEL */
-    VS1053_SendEndFill(32);   /* send endfill bytes */
-    HAL_Delay(100);
-    VS1053_GetMode(&mode);    /* get mode value */
-    if ((mode & 0x08) != 0x0) /* if SM CANCEL is not clear, soft reset */
+
+    /* Nothing is sent while DREQ is low */
+    if (!VS1053_SendEndFillChunk())
+        return;
+    stopBytes += 32;
+
+    switch (stopState)
     {
-        VS1053_SoftReset();
+    case STOP_ENDFILL:
+        if (stopBytes >= 2052)
+        {
+            VS1053_SetMode(0x4808); /* SM LINE1 | SM SDINEW | SM CANCEL */
+            stopBytes = 0;
+            stopState = STOP_CANCEL;
+        }
+        break;
+
+    case STOP_CANCEL:
+        VS1053_GetMode(&mode);
+        if ((mode & 0x08) == 0x0) /* SM CANCEL cleared */
+        {
+            MP3_StopFinish();
+        }
+        else if (stopBytes >= 2048) /* not cleared after 2048 bytes, soft reset */
+        {
+            VS1053_SetMode(0x4804); /* SM LINE1 | SM SDINEW | SM RESET */
+            pluginLost = true;
+            MP3_StopFinish();
+        }
+        break;
+
+    default:
+        break;
     }
+}
 
-    f_close(&mp3File);
+static void MP3_StopFinish(void)
+{
+    MP3_StopCallback callback = stopCallback;
+
+    if (isFileOpen)
+        f_close(&mp3File);
     isPlaying = false;  /* Stop flag */
     isFileOpen = false; /* Close flag */
+    stopState = STOP_IDLE;
+    stopCallback = NULL;
+    nextPending = false;
+
+    /* The soft reset dropped the patches, load them again before the next track */
+    if (pluginLost)
+    {
+        pluginLost = false;
+        VS1053_LoadPatches();
+        MP3_LoadPluginFile(MP3_PLUGIN_FILE);
+    }
+
+    if (callback != NULL)
+        callback();
+
+    if (pendingTrack[0] != 0)
+    {
+        char track[MP3_PATH_LEN];
+
+        strcpy(track, pendingTrack);
+        pendingTrack[0] = 0;
+        MP3_Start(track);
+    }
 }
 
 void MP3_Pause(void)
@@ -87,39 +438,410 @@ void MP3_Resume(void)
         isPlaying = true;
 }
 
-/* Send mp3 buffer to VS1053 */
-void MP3_Feeder(void)
+/*
+ * Refill the ring buffer from the file, the DREQ interrupt sends it to VS1053.
+ * Returns false when there was nothing to do (ring full, nothing playing).
+ */
+bool MP3_Feeder(void)
 {
+    uint32_t space, len, readStart;
+
+    /* Let the SD read-ahead progress in the background */
+    SD_PollAsync();
+
+    if (stopState != STOP_IDLE)
+    {
+        MP3_StopTick();
+        return true;
+    }
+
     if (!isPlaying || !isFileOpen)
-        return;
+        return false;
+
+    /* The previous track has left the ring, duration and seek now follow the next one */
+    if (nextPending && (int32_t)(ringTail - nextStart) >= 0)
+    {
+        info = nextInfo;
+        nextPending = false;
+    }
+
+    /* DREQ may already be high with no edge left to catch (resume, SCI access) */
+    if (ringHead != ringTail &&
+        HAL_GPIO_ReadPin(VS1053_DREQ_PORT, VS1053_DREQ_PIN) == GPIO_PIN_SET)
+    {
+        __HAL_GPIO_EXTI_GENERATE_SWIT(VS1053_DREQ_PIN);
+    }
+
+    if (endOfFile)
+    {
+        /* Stop when the decoder took the whole file */
+        if (ringHead == ringTail)
+            MP3_Stop();
+        return false;
+    }
+
+    space = RING_SIZE - (ringHead - ringTail);
+    if (space < SECTOR_SIZE)
+    {
+        mp3RingFullPolls++;
+        return false;
+    }
+
+    /* Fully read, the next track could not be opened while the previous one drains */
+    if (mp3FileSize == 0 && nextPending)
+        return false;
 
     /* Toggle Green LED */
     HAL_GPIO_TogglePin(GPIOD, GPIO_PIN_12);
 
-    if (mp3FileSize > BUFFER_SIZE)
-    {
-        /* Fill the buffer */
-        f_read(&mp3File, mp3Buffer, BUFFER_SIZE, (void *)&readBytes);
+    /*
+     * Read whole sectors up to the end of the ring in one call. The head and
+     * the file pointer stay sector aligned, so FatFs reads straight into the
+     * ring (multi-block) instead of copying through its sector buffer.
+     */
+    len = RING_SIZE - (ringHead & RING_MASK);
+    if (len > space)
+        len = space;
+    if (len >= SECTOR_SIZE)
+        len &= ~(SECTOR_SIZE - 1); /* the tail of the previous track can leave the head unaligned */
+    if (len > mp3FileSize)
+        len = mp3FileSize;
+
+    readStart = DWT->CYCCNT;
+    if (f_read(&mp3File, &mp3Ring[ringHead & RING_MASK], len, (void *)&readBytes) != FR_OK)
+        readBytes = 0;
+    MP3_RecordReadLatency(DWT->CYCCNT - readStart);
+    ringHead += readBytes;
+    mp3FileSize -= readBytes;
+    bufStats.refills++;
+
+    if (ringHead - ringTail > bufStats.highWatermark)
+        bufStats.highWatermark = ringHead - ringTail;
+
+    if ((mp3FileSize == 0 || readBytes == 0) && !MP3_OpenNext())
+        endOfFile = true;
+    return true;
+}
+
+/*
+ * Call once at the end of every superloop pass. A pass that found nothing to
+ * do is idle time, less what the DREQ / SDI DMA interrupts took out of it.
+ */
+void MP3_IdleTick(bool busy)
+{
+    uint32_t now = DWT->CYCCNT;
+    uint32_t dreq = dreqCycles;
+
+    if (!busy)
+        bufStats.idleCycles += (now - passStart) - (dreq - passDreq);
+    passStart = now;
+    passDreq = dreq;
+}
+
+/*
+ * Jump to ms from the start of the stream. The byte offset comes from the
+ * Xing TOC when the file has one, otherwise from the (average) bitrate.
+ * The decoder finds the next frame by itself through AutoResync.
+ */
+bool MP3_Seek(uint32_t ms)
+{
+    uint32_t offset, percent, fa, fb, fx;
+    bool wasPlaying = isPlaying;
+
+    /* Between tracks the file open is already the next one, not what is playing */
+    if (!isFileOpen || info.bitrateKbps == 0 || stopState != STOP_IDLE || nextPending)
+        return false;
 
-        /* Tx buffer */
-        VS1053_SdiWrite32(mp3Buffer);
+    if (info.durationMs != 0 && ms >= info.durationMs)
+        ms = info.durationMs - 1;
 
-        /* bytes to send */
-        mp3FileSize -= BUFFER_SIZE;
+    if (info.hasToc && info.durationMs != 0)
+    {
+        /* Interpolate between TOC entries, in 1/256 of the audio bytes */
+        percent = (uint32_t)((uint64_t)ms * 100 / info.durationMs);
+        fa = info.xingToc[percent];
+        fb = percent < 99 ? info.xingToc[percent + 1] : 256;
+        if (fb < fa)
+            fb = fa;
+        fx = fa * 1000 + (fb - fa) * (uint32_t)(((uint64_t)ms * 100000 / info.durationMs) % 1000);
+        offset = info.audioStart + (uint32_t)((uint64_t)fx * info.audioBytes / 256000);
     }
     else
     {
-        /* Read left bytes */
-        f_read(&mp3File, mp3Buffer, mp3FileSize, (void *)&readBytes);
+        offset = info.audioStart + (uint32_t)((uint64_t)ms * info.bitrateKbps / 8); /* kbit/s / 8 = bytes/ms */
+    }
+
+    /* Keep the file pointer sector aligned for direct ring refills */
+    offset &= ~(SECTOR_SIZE - 1);
+    if (offset >= f_size(&mp3File))
+        return false;
+
+    /* Stop feeding and let the chunk in flight finish */
+    isPlaying = false;
+    while (VS1053_SdiIsBusy())
+        ;
+
+    if (f_lseek(&mp3File, offset) != FR_OK)
+    {
+        isPlaying = wasPlaying;
+        return false;
+    }
+
+    mp3FileSize = f_size(&mp3File) - offset;
+    ringHead = ringTail = sdiLen = 0;
+    endOfFile = false;
+    starved = false;
+
+    VS1053_AutoResync();
+    VS1053_SetDecodeTime(ms / 1000);
+
+    isPlaying = wasPlaying;
+    return true;
+}
+
+uint32_t MP3_GetDurationMs(void)
+{
+    return info.durationMs;
+}
+
+/*
+ * Find the first Layer III frame after the ID3v2 tag and read bitrate,
+ * duration and the Xing TOC (or VBRI totals).
+ */
+static void MP3_ParseStreamInfo(MP3_StreamInfo *out)
+{
+    uint8_t *buf = infoBuffer;
+    uint32_t fileSize = f_size(&mp3File);
+    uint32_t frames = 0, bytes = 0, flags, i;
+    uint32_t sampleRate, samplesPerFrame;
+    uint8_t version, mono, sideInfo, *tag;
+    UINT br;
+
+    out->audioStart = 0;
+    out->audioBytes = fileSize;
+    out->durationMs = 0;
+    out->bitrateKbps = 0;
+    out->hasToc = false;
+
+    /* ID3v2 tag: "ID3" + version(2) + flags(1) + syncsafe size(4) */
+    if (f_read(&mp3File, buf, 10, &br) != FR_OK || br != 10)
+        goto done;
+    if (buf[0] == 'I' && buf[1] == 'D' && buf[2] == '3')
+    {
+        out->audioStart = 10 + (((uint32_t)buf[6] & 0x7F) << 21 | ((uint32_t)buf[7] & 0x7F) << 14 |
+                                ((uint32_t)buf[8] & 0x7F) << 7 | ((uint32_t)buf[9] & 0x7F));
+        if (buf[5] & 0x10)
+            out->audioStart += 10; /* footer */
+    }
+
+    if (f_lseek(&mp3File, out->audioStart) != FR_OK ||
+        f_read(&mp3File, buf, sizeof(infoBuffer), &br) != FR_OK || br < 4)
+        goto done;
+
+    /* Frame sync: 11 set bits, Layer III, valid bitrate and sample rate */
+    for (i = 0; i + 4 <= br; i++)
+    {
+        if (buf[i] == 0xFF && (buf[i + 1] & 0xE0) == 0xE0 && (buf[i + 1] & 0x06) == 0x02 &&
+            (buf[i + 2] >> 4) != 0x00 && (buf[i + 2] >> 4) != 0x0F && ((buf[i + 2] >> 2) & 0x03) != 0x03 &&
+            ((buf[i + 1] >> 3) & 0x03) != 0x01)
+            break;
+    }
+    if (i + 4 > br)
+        goto done;
 
-        /* Tx buffer */
-        for (cnt = 0; cnt < mp3FileSize; cnt++)
+    out->audioStart += i;
+    out->audioBytes = fileSize - out->audioStart;
+    buf += i;
+    br -= i;
+
+    version = (buf[1] >> 3) & 0x03; /* 3: MPEG1, 2: MPEG2, 0: MPEG2.5 */
+    mono = (buf[3] >> 6) == 0x03;
+    out->bitrateKbps = bitrateTable[version == 3 ? 0 : 1][buf[2] >> 4];
+    sampleRate = sampleRateTable[(buf[2] >> 2) & 0x03] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+    samplesPerFrame = version == 3 ? 1152 : 576;
+
+    /* Xing/Info header sits right after the side information */
+    sideInfo = version == 3 ? (mono ? 17 : 32) : (mono ? 9 : 17);
+    tag = buf + 4 + sideInfo;
+    if (4 + sideInfo + 8 <= br &&
+        (memcmp(tag, "Xing", 4) == 0 || memcmp(tag, "Info", 4) == 0))
+    {
+        flags = MP3_ReadBE32(tag + 4);
+        tag += 8;
+        if (flags & 0x01)
         {
-            while (!VS1053_SdiWrite(*(mp3Buffer + cnt)))
-                ;
+            frames = MP3_ReadBE32(tag);
+            tag += 4;
         }
+        if (flags & 0x02)
+        {
+            bytes = MP3_ReadBE32(tag);
+            tag += 4;
+        }
+        if ((flags & 0x04) && tag + 100 <= buf + br)
+        {
+            memcpy(out->xingToc, tag, sizeof(out->xingToc));
+            out->hasToc = true;
+        }
+    }
+    else if (4 + 32 + 18 <= br && memcmp(buf + 36, "VBRI", 4) == 0)
+    {
+        /* VBRI: only the totals are used, seeking falls back to the average bitrate */
+        bytes = MP3_ReadBE32(buf + 36 + 10);
+        frames = MP3_ReadBE32(buf + 36 + 14);
+    }
 
-        /* Stop when played the whole file */
-        MP3_Stop();
+    if (bytes != 0)
+        out->audioBytes = bytes;
+
+    if (frames != 0)
+    {
+        out->durationMs = (uint32_t)((uint64_t)frames * samplesPerFrame * 1000 / sampleRate);
+        if (out->durationMs != 0)
+            out->bitrateKbps = (uint32_t)((uint64_t)out->audioBytes * 8 / out->durationMs);
+    }
+    else if (out->bitrateKbps != 0)
+    {
+        out->durationMs = (uint32_t)((uint64_t)out->audioBytes * 8 / out->bitrateKbps);
+    }
+
+done:
+    f_lseek(&mp3File, 0);
+}
+
+static uint32_t MP3_ReadBE32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+/* The DREQ and SDI DMA interrupts update the stats, copy and clear them with interrupts masked */
+void MP3_GetBufferStats(MP3_BufferStats *out)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    *out = bufStats;
+    __set_PRIMASK(primask);
+}
+
+void MP3_ResetBufferStats(void)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    memset(&bufStats, 0, sizeof(bufStats));
+    bufStats.lowWatermark = RING_SIZE;
+    __set_PRIMASK(primask);
+}
+
+/* Get and reset in one step, nothing counted in between is lost */
+void MP3_TakeBufferStats(MP3_BufferStats *out)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    *out = bufStats;
+    memset(&bufStats, 0, sizeof(bufStats));
+    bufStats.lowWatermark = RING_SIZE;
+    __set_PRIMASK(primask);
+}
+
+static void MP3_RecordReadLatency(uint32_t cycles)
+{
+    uint32_t us = cycles / (SystemCoreClock / 1000000);
+    uint8_t bin = 0;
+
+    while (bin < MP3_READ_HIST_BINS - 1 && us >= (256u << bin))
+        bin++;
+    bufStats.readHist[bin]++;
+    if (cycles > bufStats.readMaxCycles)
+        bufStats.readMaxCycles = cycles;
+}
+
+/*
+ * DREQ rising edge or SDI DMA complete: send the next 32 byte chunk while
+ * VS1053 can take it. With DMA one chunk is in flight at a time and the
+ * completion interrupt calls this again, so chunks go out back-to-back.
+ */
+void MP3_DreqCallback(void)
+{
+    uint32_t start = DWT->CYCCNT;
+
+    MP3_DreqService();
+    dreqCycles += DWT->CYCCNT - start;
+}
+
+static void MP3_DreqService(void)
+{
+    uint32_t used, len, idx;
+    uint8_t *chunk;
+
+    /* The chunk in flight is done, its ring space can be reused */
+    if (sdiLen != 0 && !VS1053_SdiIsBusy())
+    {
+        ringTail += sdiLen;
+        bufStats.sdiBytes += sdiLen;
+        sdiLen = 0;
+    }
+
+    /* DREQ is back, the decoder had a full buffer until now */
+    if (dreqStalled && HAL_GPIO_ReadPin(VS1053_DREQ_PORT, VS1053_DREQ_PIN) == GPIO_PIN_SET)
+    {
+        bufStats.stallCycles += DWT->CYCCNT - stallStart;
+        dreqStalled = false;
+    }
+
+    if (!isPlaying || stopState != STOP_IDLE)
+        return;
+
+    while (sdiLen == 0 &&
+           HAL_GPIO_ReadPin(VS1053_DREQ_PORT, VS1053_DREQ_PIN) == GPIO_PIN_SET)
+    {
+        used = ringHead - ringTail;
+        if (!endOfFile)
+        {
+            /* Decoder wants data the SD side has not delivered yet */
+            if (used == 0 && !starved)
+                bufStats.underruns++;
+            starved = (used == 0);
+            if (used < bufStats.lowWatermark)
+                bufStats.lowWatermark = used;
+        }
+        if (used == 0)
+            break;
+
+        len = used < BUFFER_SIZE ? used : BUFFER_SIZE;
+        idx = ringTail & RING_MASK;
+        if (idx + len <= RING_SIZE)
+        {
+            chunk = &mp3Ring[idx];
+        }
+        else
+        {
+            /* Chunk wraps around the ring */
+            for (uint32_t i = 0; i < len; i++)
+                mp3Buffer[i] = mp3Ring[(idx + i) & RING_MASK];
+            chunk = mp3Buffer;
+        }
+
+        if (!VS1053_SdiStart(chunk, len))
+            break;
+        sdiLen = len;
+
+        /* Blocking transfer: already sent */
+        if (!VS1053_SdiIsBusy())
+        {
+            ringTail += len;
+            bufStats.sdiBytes += len;
+            sdiLen = 0;
+        }
+    }
+
+    /* Data is waiting but DREQ is low */
+    if (!dreqStalled && sdiLen == 0 && ringHead != ringTail &&
+        HAL_GPIO_ReadPin(VS1053_DREQ_PORT, VS1053_DREQ_PIN) == GPIO_PIN_RESET)
+    {
+        stallStart = DWT->CYCCNT;
+        dreqStalled = true;
     }
 }
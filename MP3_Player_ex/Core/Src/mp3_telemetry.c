@@ -0,0 +1,133 @@
+#include "mp3_telemetry.h"
+#include "mp3_player.h"
+#include "vs1053.h"
+#include <string.h>
+
+extern UART_HandleTypeDef huart2;
+
+static MP3_TelemetryFrame frame; /* must stay valid while the IT transfer runs */
+static bool enabled;
+static uint32_t lastTick;
+
+/* Enable the DWT cycle counter used for the stall and latency figures */
+void MP3_TelemetryInit(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    lastTick = HAL_GetTick();
+}
+
+void MP3_TelemetryEnable(bool enable)
+{
+    enabled = enable;
+    lastTick = HAL_GetTick();
+    MP3_ResetBufferStats();
+    VS1053_ResetSciStats();
+}
+
+bool MP3_TelemetryIsEnabled(void)
+{
+    return enabled;
+}
+
+static uint32_t MP3_CyclesToUs(uint32_t cycles)
+{
+    return cycles / (SystemCoreClock / 1000000);
+}
+
+/* Decoder registers, only read while a track is playing */
+static void MP3_TelemetryReadDecoder(void)
+{
+    uint16_t regVal;
+
+    if (!isFileOpen || MP3_IsStopping())
+        return;
+
+    /* The frame is packed, read into a local first */
+    if (VS1053_SciRead(VS1053_REG_HDAT0, &regVal))
+        frame.hdat0 = regVal;
+    if (VS1053_SciRead(VS1053_REG_HDAT1, &regVal))
+        frame.hdat1 = regVal;
+    if (VS1053_SciRead(VS1053_REG_DECODE_TIME, &regVal))
+        frame.decodeTime = regVal;
+    if (VS1053_SciRead(VS1053_REG_AUDATA, &regVal))
+        frame.sampleRate = regVal & 0xFFFE; /* bit 0: stereo */
+
+    /* byteRate, bytes/s of the stream being decoded */
+    if (VS1053_SciWrite(VS1053_REG_WRAMADDR, 0x1E05) && VS1053_SciRead(VS1053_REG_WRAM, &regVal))
+        frame.bitrateKbps = (uint32_t)regVal * 8 / 1000;
+}
+
+/* Call from the main loop, sends one frame per period. true when it sent one */
+bool MP3_TelemetryTick(void)
+{
+    MP3_BufferStats buf;
+    VS1053_SciStats sci;
+    uint32_t now = HAL_GetTick();
+    uint32_t period = now - lastTick;
+    uint8_t *p;
+    uint32_t idle;
+    uint8_t sum = 0;
+
+    if (!enabled || period < MP3_TLM_PERIOD_MS)
+        return false;
+
+    /* Previous frame still going out, try again next call */
+    if (huart2.gState != HAL_UART_STATE_READY)
+        return false;
+
+    MP3_TakeBufferStats(&buf);
+    VS1053_GetSciStats(&sci);
+    VS1053_ResetSciStats();
+    lastTick = now;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.sync[0] = 0x55;
+    frame.sync[1] = 0xAA;
+    frame.type[0] = 'T';
+    frame.type[1] = '1';
+    frame.len = sizeof(frame) - 6;
+    frame.tick = now;
+    frame.periodMs = period;
+
+    MP3_TelemetryReadDecoder();
+
+    frame.sdiBytesPerSec = (uint64_t)buf.sdiBytes * 1000 / period;
+    frame.underruns = buf.underruns;
+    frame.refills = buf.refills;
+    frame.stallUs = MP3_CyclesToUs(buf.stallCycles);
+    frame.sciWaitUs = MP3_CyclesToUs(sci.dreqWaitCycles);
+    idle = MP3_CyclesToUs(buf.idleCycles) / period; /* us per ms of the period */
+    frame.idlePermille = idle > 1000 ? 1000 : idle;
+    frame.ringLow = buf.lowWatermark;
+    frame.ringHigh = buf.highWatermark;
+    frame.readMaxUs = MP3_CyclesToUs(buf.readMaxCycles);
+    for (uint8_t i = 0; i < MP3_READ_HIST_BINS; i++)
+        frame.readHist[i] = buf.readHist[i] > 0xFFFF ? 0xFFFF : buf.readHist[i];
+
+    for (p = (uint8_t *)&frame.tick; p < &frame.checksum; p++)
+        sum += *p;
+    frame.checksum = sum;
+
+    HAL_UART_Transmit_IT(&huart2, (uint8_t *)&frame, sizeof(frame));
+    return true;
+}
+
+/*
+ * Console text on USART2. All output goes through here or MP3_TelemetryTick,
+ * both from the main loop, so a line never cuts into a frame: wait for the
+ * frame in flight to finish, then send the text blocking.
+ */
+bool MP3_TelemetryPrint(const char *text, uint16_t len)
+{
+    uint32_t start = HAL_GetTick();
+
+    while (huart2.gState != HAL_UART_STATE_READY)
+    {
+        if (HAL_GetTick() - start >= MP3_TLM_TX_TIMEOUT_MS)
+            return false;
+    }
+    return HAL_UART_Transmit(&huart2, (uint8_t *)text, len, MP3_TLM_TX_TIMEOUT_MS) == HAL_OK;
+}
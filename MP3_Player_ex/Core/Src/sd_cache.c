@@ -0,0 +1,254 @@
+#include "sd_cache.h"
+
+#include <string.h>
+
+#include "fatfs_sd.h"
+#include "sd_prefetch.h"
+
+typedef struct {
+    DWORD    sector;
+    uint32_t last_used;
+    bool     valid;
+    bool     dirty;
+} SD_Cache_Entry;
+
+static SD_Cache_Entry entries[SD_CACHE_ENTRIES];
+static BYTE           blocks[SD_CACHE_ENTRIES][SD_CACHE_SECTOR_SIZE];
+static uint32_t       use_counter;
+static SD_Cache_Stats stats;
+
+static int     SD_Cache_Find(DWORD sector);
+static int     SD_Cache_Alloc(BYTE pdrv, DWORD sector);
+static void    SD_Cache_Touch(int idx);
+static DRESULT SD_Cache_ReadThrough(BYTE pdrv, BYTE *buff, DWORD sector,
+                                    UINT count);
+
+void SD_Cache_Init() {
+    memset(entries, 0, sizeof(entries));
+    use_counter = 0;
+    SD_Prefetch_Init();
+}
+
+DRESULT SD_Cache_Read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count) {
+    DRESULT res;
+    int     idx;
+
+    if (count == 1) {
+        idx = SD_Cache_Find(sector);
+        if (idx >= 0) {
+            stats.hits++;
+            memcpy(buff, blocks[idx], SD_CACHE_SECTOR_SIZE);
+            SD_Cache_Touch(idx);
+            return RES_OK;
+        }
+        stats.misses++;
+
+        /**
+         * 파일을 순서대로 읽는 중이라면 캐시 대신 read-ahead 버퍼를 쓴다.
+         * (스트리밍 데이터가 메타데이터를 캐시에서 밀어내지 않도록)
+         */
+        if (SD_Prefetch_Read(pdrv, buff, sector, &res)) {
+            return res;
+        }
+
+        /**
+         * 1섹터 읽기는 대부분 FAT/디렉터리이므로 다시 읽힐 가능성이 높다.
+         * 캐시에 올려둔다.
+         */
+        idx = SD_Cache_Alloc(pdrv, sector);
+        if (idx < 0) {
+            return SD_Read(pdrv, buff, sector, count);
+        }
+        if (SD_Read(pdrv, blocks[idx], sector, 1) != RES_OK) {
+            entries[idx].valid = false;
+            return RES_ERROR;
+        }
+        memcpy(buff, blocks[idx], SD_CACHE_SECTOR_SIZE);
+        return RES_OK;
+    }
+
+    return SD_Cache_ReadThrough(pdrv, buff, sector, count);
+}
+
+DRESULT SD_Cache_Write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count) {
+    int idx;
+
+    SD_Prefetch_Invalidate(sector, count);
+
+    if (count == 1) {
+        idx = SD_Cache_Find(sector);
+        if (idx >= 0) {
+            stats.hits++;
+        } else {
+            stats.misses++;
+            idx = SD_Cache_Alloc(pdrv, sector);
+            if (idx < 0) {
+                return SD_Write(pdrv, buff, sector, count);
+            }
+        }
+        memcpy(blocks[idx], buff, SD_CACHE_SECTOR_SIZE);
+        entries[idx].dirty = true;
+        SD_Cache_Touch(idx);
+        return RES_OK;
+    }
+
+    /**
+     * 여러 섹터 쓰기는 곧바로 카드에 쓴다(write-through). 캐시에 같은 섹터가
+     * 있다면 내용을 맞춰두고 clean으로 표시한다.
+     */
+    if (SD_Write(pdrv, buff, sector, count) != RES_OK) {
+        return RES_ERROR;
+    }
+    for (int i = 0; i < SD_CACHE_ENTRIES; i++) {
+        if (entries[i].valid && entries[i].sector >= sector &&
+            entries[i].sector < sector + count) {
+            memcpy(blocks[i],
+                   buff + (entries[i].sector - sector) * SD_CACHE_SECTOR_SIZE,
+                   SD_CACHE_SECTOR_SIZE);
+            entries[i].dirty = false;
+        }
+    }
+    return RES_OK;
+}
+
+/**
+ * dirty 섹터들을 섹터 번호 순으로 정렬한 뒤 연속된 구간끼리 묶어서 쓴다.
+ */
+DRESULT SD_Cache_Sync(BYTE pdrv) {
+    uint8_t     order[SD_CACHE_ENTRIES];
+    const BYTE *run[SD_CACHE_ENTRIES];
+    UINT        n = 0;
+    DRESULT     res = RES_OK, res_run;
+
+    for (int i = 0; i < SD_CACHE_ENTRIES; i++) {
+        if (!entries[i].valid || !entries[i].dirty) {
+            continue;
+        }
+        /* insertion sort */
+        UINT j = n++;
+        while (j > 0 && entries[order[j - 1]].sector > entries[i].sector) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    for (UINT i = 0; i < n;) {
+        DWORD first = entries[order[i]].sector;
+        UINT  len   = 0;
+
+        while (i + len < n && entries[order[i + len]].sector == first + len) {
+            run[len] = blocks[order[i + len]];
+            len++;
+        }
+
+        /**
+         * dirty인 동안 read-ahead가 이 섹터들의 옛 내용을 읽어왔을 수 있다.
+         * 캐시에서 밀려난 뒤 그 내용이 읽히지 않도록 쓰고 나서 버린다.
+         */
+        stats.flushes++;
+        res_run = SD_WriteBlocks(pdrv, run, first, len);
+        SD_Prefetch_Invalidate(first, len);
+        if (res_run == RES_OK) {
+            stats.flushed_sectors += len;
+            for (UINT k = 0; k < len; k++) {
+                entries[order[i + k]].dirty = false;
+            }
+        } else {
+            res = RES_ERROR;
+        }
+        i += len;
+    }
+
+    return res;
+}
+
+DRESULT SD_Cache_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
+    DRESULT res = RES_OK, res_card;
+
+    if (cmd == CTRL_SYNC) {
+        res = SD_Cache_Sync(pdrv);
+    } else if (cmd == CTRL_TRIM) {
+        /* 지워질 섹터는 캐시와 read-ahead 창에서 버린다 */
+        DWORD *range = (DWORD *)buff;
+        for (int i = 0; i < SD_CACHE_ENTRIES; i++) {
+            if (entries[i].valid && entries[i].sector >= range[0] &&
+                entries[i].sector <= range[1]) {
+                entries[i].valid = false;
+                entries[i].dirty = false;
+            }
+        }
+        SD_Prefetch_Invalidate(range[0], range[1] - range[0] + 1);
+    }
+    /* 캐시가 모르는 명령의 RES_PARERR 등 카드 쪽 결과는 그대로 돌려준다 */
+    res_card = SD_ioctl(pdrv, cmd, buff);
+    if (res_card != RES_OK) {
+        res = res_card;
+    }
+    return res;
+}
+
+void SD_Cache_GetStats(SD_Cache_Stats *out) { *out = stats; }
+
+void SD_Cache_ResetStats() { memset(&stats, 0, sizeof(stats)); }
+
+static int SD_Cache_Find(DWORD sector) {
+    for (int i = 0; i < SD_CACHE_ENTRIES; i++) {
+        if (entries[i].valid && entries[i].sector == sector) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * 빈 엔트리가 없으면 가장 오래 쓰이지 않은(LRU) 엔트리를 비운다. 비울
+ * 엔트리가 dirty라면 다른 dirty 섹터들과 함께 한 번에 flush한다.
+ */
+static int SD_Cache_Alloc(BYTE pdrv, DWORD sector) {
+    int victim = 0;
+
+    for (int i = 0; i < SD_CACHE_ENTRIES; i++) {
+        if (!entries[i].valid) {
+            victim = i;
+            break;
+        }
+        if (entries[i].last_used < entries[victim].last_used) {
+            victim = i;
+        }
+    }
+
+    if (entries[victim].valid) {
+        stats.evictions++;
+        if (entries[victim].dirty && SD_Cache_Sync(pdrv) != RES_OK) {
+            return -1;
+        }
+    }
+
+    entries[victim].sector = sector;
+    entries[victim].valid  = true;
+    entries[victim].dirty  = false;
+    SD_Cache_Touch(victim);
+    return victim;
+}
+
+static void SD_Cache_Touch(int idx) { entries[idx].last_used = ++use_counter; }
+
+/**
+ * 구간 전체를 한 번의 CMD18로 읽고, 아직 카드에 쓰지 않은 dirty 섹터는 캐시
+ * 내용으로 덮어쓴다.
+ */
+static DRESULT SD_Cache_ReadThrough(BYTE pdrv, BYTE *buff, DWORD sector,
+                                    UINT count) {
+    if (SD_Read(pdrv, buff, sector, count) != RES_OK) {
+        return RES_ERROR;
+    }
+    for (int i = 0; i < SD_CACHE_ENTRIES; i++) {
+        if (entries[i].valid && entries[i].dirty &&
+            entries[i].sector >= sector && entries[i].sector < sector + count) {
+            memcpy(buff + (entries[i].sector - sector) * SD_CACHE_SECTOR_SIZE,
+                   blocks[i], SD_CACHE_SECTOR_SIZE);
+        }
+    }
+    return RES_OK;
+}
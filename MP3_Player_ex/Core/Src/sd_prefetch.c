@@ -0,0 +1,169 @@
+#include "sd_prefetch.h"
+
+#include <string.h>
+
+#include "fatfs_sd.h"
+
+/**
+ * ring[i]에는 (ring_sector + i)번 섹터가 들어있다.
+ * ring_pos 이전의 섹터는 이미 소비되었고, ring_len이 0이면 비어있다.
+ */
+static BYTE          ring[SD_PREFETCH_DEPTH][SD_PREFETCH_SECTOR_SIZE];
+static DWORD         ring_sector;
+static UINT          ring_pos;
+static UINT          ring_len;
+static volatile bool fill_pending;
+static DWORD         stream_next = 0xFFFFFFFF;
+
+/**
+ * 보호 구간(FAT/디렉터리 영역). 스트리밍 도중 이 구간을 읽는 것은 클러스터
+ * 경계의 FAT 조회이므로 미리 읽은 구간을 버리지 않는다.
+ */
+static DWORD meta_first;
+static DWORD meta_count;
+
+static SD_Prefetch_Stats stats = {SD_PREFETCH_DEPTH};
+
+static void SD_Prefetch_FillAsync(DWORD sector);
+static void SD_Prefetch_FillDone(DRESULT result);
+static void SD_Prefetch_WaitFill();
+static void SD_Prefetch_Drop();
+
+void SD_Prefetch_Init() {
+    SD_Prefetch_WaitFill();
+    ring_len    = 0;
+    ring_pos    = 0;
+    stream_next = 0xFFFFFFFF;
+}
+
+/**
+ * 마운트 후 FAT 시작부터 데이터 영역 앞까지를 넘겨준다.
+ * (예: fs.fatbase, fs.database - fs.fatbase)
+ */
+void SD_Prefetch_SetMetaWindow(DWORD first, DWORD count) {
+    meta_first = first;
+    meta_count = count;
+}
+
+/**
+ * 미리 읽어둔 섹터이거나 연속 읽기로 판단되면 여기서 처리하고 true를
+ * 반환한다. false면 호출한 쪽에서 직접 읽어야 한다.
+ */
+bool SD_Prefetch_Read(BYTE pdrv, BYTE *buff, DWORD sector, DRESULT *res) {
+    UINT idx;
+
+    if (ring_len && sector >= ring_sector + ring_pos &&
+        sector < ring_sector + ring_len) {
+        SD_Prefetch_WaitFill();
+    }
+
+    if (ring_len && sector >= ring_sector + ring_pos &&
+        sector < ring_sector + ring_len) {
+        stats.hits++;
+        idx = sector - ring_sector;
+        memcpy(buff, ring[idx], SD_PREFETCH_SECTOR_SIZE);
+
+        stats.wasted += idx - ring_pos;
+        ring_pos     = idx + 1;
+        stream_next  = sector + 1;
+
+        /**
+         * 모두 소비했으면 버퍼가 비었으므로 다음 구간을 비동기로 채운다.
+         */
+        if (ring_pos == ring_len) {
+            SD_Prefetch_FillAsync(ring_sector + ring_len);
+        }
+        *res = RES_OK;
+        return true;
+    }
+
+    /**
+     * 직전 읽기의 다음 섹터가 아니면 스트리밍이 아니다. 보호 구간 안의 읽기
+     * (FAT 조회)는 stream_next를 그대로 두고, 그 밖의 읽기는 탐색이나 다른
+     * 파일이므로 미리 읽은 구간을 버리고 이 섹터부터 다시 감지한다.
+     */
+    if (sector != stream_next) {
+        if (sector - meta_first >= meta_count) {
+            SD_Prefetch_Drop();
+            stream_next = sector + 1;
+        }
+        return false;
+    }
+
+    /**
+     * 연속 읽기인데 미리 읽어둔 섹터가 없으면 요청한 섹터부터 DEPTH개를 한
+     * 번에 읽는다.
+     */
+    stats.misses++;
+    SD_Prefetch_Drop();
+
+    if (SD_Read(pdrv, ring[0], sector, SD_PREFETCH_DEPTH) != RES_OK) {
+        return false;
+    }
+    stats.prefetched += SD_PREFETCH_DEPTH - 1;
+    ring_sector = sector;
+    ring_pos    = 1;
+    ring_len    = SD_PREFETCH_DEPTH;
+    stream_next = sector + 1;
+
+    memcpy(buff, ring[0], SD_PREFETCH_SECTOR_SIZE);
+    *res = RES_OK;
+    return true;
+}
+
+/**
+ * 쓰기로 내용이 바뀐 섹터가 미리 읽은 구간에 있으면 버린다.
+ */
+void SD_Prefetch_Invalidate(DWORD sector, UINT count) {
+    if (ring_len && sector < ring_sector + ring_len &&
+        sector + count > ring_sector) {
+        SD_Prefetch_Drop();
+    }
+}
+
+void SD_Prefetch_GetStats(SD_Prefetch_Stats *out) { *out = stats; }
+
+void SD_Prefetch_ResetStats() {
+    memset(&stats, 0, sizeof(stats));
+    stats.depth = SD_PREFETCH_DEPTH;
+}
+
+static void SD_Prefetch_FillAsync(DWORD sector) {
+    ring_sector  = sector;
+    ring_pos     = 0;
+    ring_len     = SD_PREFETCH_DEPTH;
+    fill_pending = true;
+    if (!SD_ReadAsync(ring[0], sector, SD_PREFETCH_DEPTH,
+                      SD_Prefetch_FillDone)) {
+        fill_pending = false;
+        ring_len     = 0;
+        return;
+    }
+    stats.prefetched += SD_PREFETCH_DEPTH;
+}
+
+static void SD_Prefetch_FillDone(DRESULT result) {
+    fill_pending = false;
+    if (result != RES_OK) {
+        ring_len = 0;
+    }
+}
+
+static void SD_Prefetch_WaitFill() {
+    while (fill_pending) {
+        SD_PollAsync();
+    }
+}
+
+/**
+ * 진행 중인 채우기를 끝낸 뒤 남은 섹터를 버린다. 채우기가 실패했으면
+ * ring_len이 이미 0이다.
+ */
+static void SD_Prefetch_Drop() {
+    SD_Prefetch_WaitFill();
+    if (ring_len) {
+        stats.wasted += ring_len - ring_pos;
+    }
+    ring_len = 0;
+    ring_pos = 0;
+}
@@ -0,0 +1,242 @@
+#include "spi_bus.h"
+#include <string.h>
+
+/*
+ * One owner per SPI peripheral. Devices keep their own clock settings and
+ * chip select, switching between them only rewrites CR1 (BR, CPOL, CPHA)
+ * instead of running HAL_SPI_Init.
+ *
+ * A device that fails to get the bus is queued by priority. On release the
+ * bus is reserved for the best waiter and its grant hook is called, so an
+ * SDI chunk from the DREQ interrupt gets in between two SD sectors.
+ */
+
+#define SPI_CR1_SETTINGS (SPI_CR1_BR | SPI_CR1_CPOL | SPI_CR1_CPHA)
+
+SPI_Bus spiBus1;
+SPI_Bus spiBus2;
+
+void SPI_Bus_Init(SPI_Bus *bus, SPI_HandleTypeDef *hspi)
+{
+    memset(bus, 0, sizeof(*bus));
+    bus->hspi = hspi;
+
+    /* Reservations expire on CYCCNT, which stays frozen until the cycle counter is enabled */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/* Write the device settings to CR1, the bus is idle here */
+static void SPI_Bus_Apply(SPI_Bus *bus, SPI_BusDevice *dev)
+{
+    SPI_TypeDef *spi = bus->hspi->Instance;
+    uint32_t start = DWT->CYCCNT;
+    uint32_t cycles;
+    uint32_t spe = spi->CR1 & SPI_CR1_SPE;
+
+    /* BR/CPOL/CPHA may only change with SPE off, HAL turns it back on at the next transfer */
+    CLEAR_BIT(spi->CR1, SPI_CR1_SPE);
+    MODIFY_REG(spi->CR1, SPI_CR1_SETTINGS, dev->prescaler | dev->polarity | dev->phase);
+    SET_BIT(spi->CR1, spe);
+
+    /* Keep the handle in step for anything that still calls HAL_SPI_Init */
+    bus->hspi->Init.BaudRatePrescaler = dev->prescaler;
+    bus->hspi->Init.CLKPolarity = dev->polarity;
+    bus->hspi->Init.CLKPhase = dev->phase;
+    bus->config = dev;
+
+    cycles = DWT->CYCCNT - start;
+    bus->stats.switches++;
+    bus->stats.switchCycles += cycles;
+    if (cycles > bus->stats.maxSwitchCycles)
+        bus->stats.maxSwitchCycles = cycles;
+}
+
+static void SPI_Bus_Enqueue(SPI_Bus *bus, SPI_BusDevice *dev)
+{
+    SPI_BusDevice **link = &bus->queue[dev->priority];
+
+    if (dev->queued)
+        return;
+    while (*link != NULL)
+        link = &(*link)->next;
+    dev->next = NULL;
+    dev->queued = true;
+    *link = dev;
+}
+
+static void SPI_Bus_Dequeue(SPI_Bus *bus, SPI_BusDevice *dev)
+{
+    SPI_BusDevice **link = &bus->queue[dev->priority];
+
+    if (!dev->queued)
+        return;
+    while (*link != dev)
+        link = &(*link)->next;
+    *link = dev->next;
+    dev->queued = false;
+}
+
+/* Non-blocking, also used from interrupts. Queues the device when it fails */
+bool SPI_Bus_TryAcquire(SPI_Bus *bus, SPI_BusDevice *dev)
+{
+    SPI_BusDevice *reserved;
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    if (bus->owner == dev)
+    {
+        __set_PRIMASK(primask);
+        return true;
+    }
+
+    /* Free, and either not reserved or reserved for someone less urgent */
+    reserved = bus->reserved;
+    if (reserved != NULL &&
+        DWT->CYCCNT - bus->reservedAt > SPI_BUS_RESERVE_US * (SystemCoreClock / 1000000))
+        reserved = bus->reserved = NULL;
+    if (bus->owner != NULL ||
+        (reserved != NULL && reserved != dev && reserved->priority <= dev->priority))
+    {
+        SPI_Bus_Enqueue(bus, dev);
+        bus->stats.contentions++;
+        __set_PRIMASK(primask);
+        return false;
+    }
+    bus->owner = dev;
+    bus->reserved = NULL;
+    SPI_Bus_Dequeue(bus, dev);
+    __set_PRIMASK(primask);
+
+    if (bus->config != dev)
+        SPI_Bus_Apply(bus, dev);
+    if (dev->csPort != NULL)
+        HAL_GPIO_WritePin(dev->csPort, dev->csPin, GPIO_PIN_RESET);
+    bus->stats.acquires++;
+    return true;
+}
+
+/* Main loop only: wait for the bus, letting the current owner make progress */
+void SPI_Bus_Acquire(SPI_Bus *bus, SPI_BusDevice *dev)
+{
+    while (!SPI_Bus_TryAcquire(bus, dev))
+    {
+        SPI_BusDevice *owner = bus->owner;
+
+        if (owner != NULL && owner->poll != NULL)
+            owner->poll();
+    }
+}
+
+void SPI_Bus_Release(SPI_Bus *bus, SPI_BusDevice *dev)
+{
+    SPI_BusDevice *next = NULL;
+    uint32_t primask = __get_PRIMASK();
+
+    if (bus->owner != dev)
+        return;
+    if (dev->csPort != NULL)
+        HAL_GPIO_WritePin(dev->csPort, dev->csPin, GPIO_PIN_SET);
+
+    __disable_irq();
+    bus->owner = NULL;
+    for (uint8_t prio = 0; prio < SPI_BUS_PRIO_COUNT && next == NULL; prio++)
+        next = bus->queue[prio];
+    if (next != NULL)
+    {
+        SPI_Bus_Dequeue(bus, next);
+        bus->reserved = next;
+        bus->reservedAt = DWT->CYCCNT;
+        bus->stats.grants[next->priority]++;
+    }
+    __set_PRIMASK(primask);
+
+    if (next != NULL && next->grant != NULL)
+        next->grant();
+}
+
+/* true if a device more urgent than the given priority is waiting */
+bool SPI_Bus_HasWaiter(SPI_Bus *bus, SPI_BusPriority than)
+{
+    for (uint8_t prio = 0; prio < than; prio++)
+    {
+        if (bus->queue[prio] != NULL)
+            return true;
+    }
+    return false;
+}
+
+bool SPI_Bus_IsOwner(SPI_Bus *bus, SPI_BusDevice *dev)
+{
+    return bus->owner == dev;
+}
+
+/* New clock for a device, applied now if its settings are the active ones */
+void SPI_Bus_SetPrescaler(SPI_Bus *bus, SPI_BusDevice *dev, uint32_t prescaler)
+{
+    dev->prescaler = prescaler;
+    if (bus->config == dev)
+        bus->config = NULL;
+    if (bus->owner == dev)
+        SPI_Bus_Apply(bus, dev);
+}
+
+void SPI_Bus_GetStats(SPI_Bus *bus, SPI_BusStats *out)
+{
+    *out = bus->stats;
+}
+
+void SPI_Bus_ResetStats(SPI_Bus *bus)
+{
+    memset(&bus->stats, 0, sizeof(bus->stats));
+}
+
+/*
+ * Cost of switching between two devices, rounds times each way: CR1 writes
+ * against a full HAL_SPI_Init. The bus must be idle, averages are returned.
+ */
+bool SPI_Bus_Benchmark(SPI_Bus *bus, SPI_BusDevice *a, SPI_BusDevice *b, uint16_t rounds,
+                       uint32_t *directCycles, uint32_t *halInitCycles)
+{
+    SPI_BusStats saved = bus->stats;
+    uint32_t start;
+
+    if (rounds == 0)
+        return false;
+    if (!SPI_Bus_TryAcquire(bus, a))
+    {
+        /* Not a real waiter, nobody will poll for the grant */
+        uint32_t primask = __get_PRIMASK();
+
+        __disable_irq();
+        SPI_Bus_Dequeue(bus, a);
+        if (bus->reserved == a)
+            bus->reserved = NULL;
+        __set_PRIMASK(primask);
+        return false;
+    }
+
+    start = DWT->CYCCNT;
+    for (uint16_t i = 0; i < rounds; i++)
+    {
+        SPI_Bus_Apply(bus, b);
+        SPI_Bus_Apply(bus, a);
+    }
+    *directCycles = (DWT->CYCCNT - start) / (2 * rounds);
+
+    start = DWT->CYCCNT;
+    for (uint16_t i = 0; i < rounds; i++)
+    {
+        bus->hspi->Init.BaudRatePrescaler = b->prescaler;
+        HAL_SPI_Init(bus->hspi);
+        bus->hspi->Init.BaudRatePrescaler = a->prescaler;
+        HAL_SPI_Init(bus->hspi);
+    }
+    *halInitCycles = (DWT->CYCCNT - start) / (2 * rounds);
+
+    /* The benchmark switches are not real traffic */
+    bus->stats = saved;
+    bus->config = NULL;
+    SPI_Bus_Release(bus, a);
+    return true;
+}
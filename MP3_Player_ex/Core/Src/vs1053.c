@@ -1,4 +1,5 @@
 #include "vs1053.h"
+#include <string.h>
 
 /* Commands */
 #define VS1053_WRITE_CMD 0x02;
@@ -34,70 +35,239 @@ const uint8_t VS1053_REG_AICTRL3 = 0x0F;
 /* endFill byte is required to stop playing */
 uint8_t endFillByte;
 
-/* SCI Tx */
-bool VS1053_SciWrite(uint8_t address, uint16_t input)
+/* One chunk of endFill bytes, reused for every endfill transfer */
+static uint8_t endFillBuffer[32];
+
+/* SDI state shared with the DREQ / DMA interrupts */
+static volatile bool sdiBusy; /* DMA transfer in flight */
+
+static void VS1053_SdiGrant(void);
+
+/*
+ * Two users of the bus: the main loop (SCI frames and blocking SDI, XCS/XDCS
+ * toggled here) and the DREQ interrupt (SDI chunks, XDCS driven by the bus).
+ * Both start at 1.31MHz until CLOCKF is raised.
+ */
+static SPI_BusDevice sciDev = {
+    .prescaler = SPI_BAUDRATEPRESCALER_32,
+    .polarity = SPI_POLARITY_LOW,
+    .phase = SPI_PHASE_1EDGE,
+    .priority = SPI_BUS_PRIO_CONTROL,
+};
+static SPI_BusDevice sdiDev = {
+    .csPort = VS1053_XDCS_PORT,
+    .csPin = VS1053_XDCS_PIN,
+    .prescaler = SPI_BAUDRATEPRESCALER_32,
+    .polarity = SPI_POLARITY_LOW,
+    .phase = SPI_PHASE_1EDGE,
+    .priority = SPI_BUS_PRIO_AUDIO,
+    .grant = VS1053_SdiGrant,
+};
+
+/* Main loop side, waits for the chunk in flight (or an SD sector on a shared bus) */
+static void VS1053_BusLock(void)
+{
+    SPI_Bus_Acquire(VS1053_BUS, &sciDev);
+}
+
+static void VS1053_BusUnlock(void)
+{
+    SPI_Bus_Release(VS1053_BUS, &sciDev);
+}
+
+/* The bus came free after VS1053_SdiStart was turned away, run the DREQ path again */
+static void VS1053_SdiGrant(void)
+{
+    __HAL_GPIO_EXTI_GENERATE_SWIT(VS1053_DREQ_PIN);
+}
+
+/* Registers that are mostly written, their last value is kept to skip repeats */
+#define SCI_SHADOW_MASK ((1 << 0x00) | (1 << 0x02) | (1 << 0x03) | (1 << 0x0B)) /* MODE, BASS, CLOCKF, VOL */
+#define SM_RESET 0x0004
+#define SM_CANCEL 0x0008
+
+static uint16_t sciShadow[16];
+static uint16_t sciShadowValid; /* bit n: sciShadow[n] matches the chip */
+static VS1053_SciStats sciStats;
+
+/* Wait DREQ High, the time spent is counted in cycles (DWT) */
+#define DREQ_WAIT_HIGH                                                                \
+    do                                                                                \
+    {                                                                                 \
+        uint32_t waitStart = DWT->CYCCNT;                                             \
+        while (HAL_GPIO_ReadPin(VS1053_DREQ_PORT, VS1053_DREQ_PIN) == GPIO_PIN_RESET) \
+            ;                                                                         \
+        sciStats.dreqWaitCycles += DWT->CYCCNT - waitStart;                           \
+    } while (0)
+
+/* true if the write would not change the chip */
+static bool VS1053_SciShadowHit(uint8_t address, uint16_t input)
+{
+    return address < 16 && (sciShadowValid & (1 << address)) && sciShadow[address] == input;
+}
+
+static void VS1053_SciShadowUpdate(uint8_t address, uint16_t input)
+{
+    if (address == VS1053_REG_MODE && (input & SM_RESET))
+    {
+        sciShadowValid = 0; /* every register goes back to its default */
+        return;
+    }
+    if (address >= 16 || !(SCI_SHADOW_MASK & (1 << address)))
+        return;
+
+    /* SM_CANCEL clears itself, so MODE no longer matches what was written */
+    if (address == VS1053_REG_MODE && (input & SM_CANCEL))
+    {
+        sciShadowValid &= ~(1 << address);
+        return;
+    }
+    sciShadow[address] = input;
+    sciShadowValid |= 1 << address;
+}
+
+/* One SCI write frame, caller waits for DREQ and holds the bus */
+static bool VS1053_SciTransfer(uint8_t address, uint16_t input)
 {
     uint8_t buffer[4];
+    bool ok;
 
     buffer[0] = VS1053_WRITE_CMD;
     buffer[1] = address;
     buffer[2] = input >> 8;     /* Input MSB */
     buffer[3] = input & 0x00FF; /* Input LSB */
 
-    while (HAL_GPIO_ReadPin(VS1053_DREQ_PORT, VS1053_DREQ_PIN) == GPIO_PIN_RESET)
-        ; /* Wait DREQ High */
-
     XCS_LOW; /* XCS Low */
-    if (HAL_SPI_Transmit(HSPI_VS1053, buffer, sizeof(buffer), 10) != HAL_OK)
-        return false;
+    ok = HAL_SPI_Transmit(HSPI_VS1053, buffer, sizeof(buffer), 10) == HAL_OK;
     XCS_HIGH; /* XCS High */
 
-    while (HAL_GPIO_ReadPin(VS1053_DREQ_PORT, VS1053_DREQ_PIN) == GPIO_PIN_RESET)
-        ; /* Wait DREQ High */
+    if (ok)
+    {
+        VS1053_SciShadowUpdate(address, input);
+        sciStats.writes++;
+    }
+    return ok;
+}
+
+/* SCI Tx */
+bool VS1053_SciWrite(uint8_t address, uint16_t input)
+{
+    bool ok;
+
+    if (VS1053_SciShadowHit(address, input))
+    {
+        sciStats.skippedWrites++;
+        return true;
+    }
+
+    DREQ_WAIT_HIGH;
+
+    VS1053_BusLock();
+    ok = VS1053_SciTransfer(address, input);
+    VS1053_BusUnlock();
+    if (!ok)
+        return false;
+
+    DREQ_WAIT_HIGH;
     return true;
 }
 
+/*
+ * Run a list of SCI writes in one pass: the bus is locked once and DREQ is
+ * only waited on before each frame (and once at the end), not before and
+ * after every register. Writes that match the shadow are skipped.
+ */
+bool VS1053_SciBatch(const VS1053_SciOp *ops, uint8_t count)
+{
+    bool ok = true;
+    uint8_t sent = 0;
+
+    sciStats.batches++;
+    VS1053_BusLock();
+    for (uint8_t i = 0; i < count && ok; i++)
+    {
+        if (VS1053_SciShadowHit(ops[i].address, ops[i].value))
+        {
+            sciStats.skippedWrites++;
+            continue;
+        }
+        DREQ_WAIT_HIGH;
+        ok = VS1053_SciTransfer(ops[i].address, ops[i].value);
+        sent++;
+    }
+    VS1053_BusUnlock();
+
+    if (sent == 0)
+        return ok;
+
+    /* n frames cost n + 1 waits here against 2n as single writes */
+    sciStats.savedDreqWaits += sent - 1;
+    DREQ_WAIT_HIGH;
+    return ok;
+}
+
 /* SCI TxRx */
 bool VS1053_SciRead(uint8_t address, uint16_t *res)
 {
-    uint8_t dummy = 0xFF;
-    uint8_t txBuffer[2];
-    uint8_t rxBuffer[2];
+    uint8_t txBuffer[4] = {0, 0, 0xFF, 0xFF};
+    uint8_t rxBuffer[4];
+    bool ok;
 
     txBuffer[0] = VS1053_READ_CMD;
     txBuffer[1] = address;
 
-    while (HAL_GPIO_ReadPin(VS1053_DREQ_PORT, VS1053_DREQ_PIN) == GPIO_PIN_RESET)
-        ; /* Wait DREQ High */
+    DREQ_WAIT_HIGH;
 
+    /* Command, address and both data bytes in one transfer */
+    VS1053_BusLock();
     XCS_LOW; /* XCS Low */
-    if (HAL_SPI_Transmit(HSPI_VS1053, txBuffer, sizeof(txBuffer), 10) != HAL_OK)
-        return false;
-    if (HAL_SPI_TransmitReceive(HSPI_VS1053, &dummy, &rxBuffer[0], 1, 10) != HAL_OK)
-        return false;
-    if (HAL_SPI_TransmitReceive(HSPI_VS1053, &dummy, &rxBuffer[1], 1, 10) != HAL_OK)
-        return false;
+    ok = HAL_SPI_TransmitReceive(HSPI_VS1053, txBuffer, rxBuffer, sizeof(txBuffer), 10) == HAL_OK;
     XCS_HIGH; /* XCS High */
+    VS1053_BusUnlock();
+    if (!ok)
+        return false;
 
-    *res = rxBuffer[0];  /* Received data */
+    *res = rxBuffer[2];  /* Received data */
     *res <<= 8;          /* MSB */
-    *res |= rxBuffer[1]; /* LSB */
+    *res |= rxBuffer[3]; /* LSB */
 
-    while (HAL_GPIO_ReadPin(VS1053_DREQ_PORT, VS1053_DREQ_PIN) == GPIO_PIN_RESET)
-        ; /* Wait DREQ High */
+    sciStats.reads++;
+    if (address < 16 && (SCI_SHADOW_MASK & (1 << address)))
+    {
+        sciShadow[address] = *res;
+        sciShadowValid |= 1 << address;
+    }
+
+    DREQ_WAIT_HIGH;
     return true;
 }
 
+void VS1053_GetSciStats(VS1053_SciStats *out)
+{
+    *out = sciStats;
+}
+
+void VS1053_ResetSciStats()
+{
+    memset(&sciStats, 0, sizeof(sciStats));
+}
+
 /* SDI Tx */
 bool VS1053_SdiWrite(uint8_t input)
 {
     while (HAL_GPIO_ReadPin(VS1053_DREQ_PORT, VS1053_DREQ_PIN) == GPIO_PIN_RESET)
         ; /* Wait DREQ High */
 
+    VS1053_BusLock();
     XDCS_LOW; /* XDCS Low(SDI) */
     if (HAL_SPI_Transmit(HSPI_VS1053, &input, 1, 10) != HAL_OK)
+    {
+        XDCS_HIGH;
+        VS1053_BusUnlock();
         return false; /* SPI Tx 1 byte */
+    }
     XDCS_HIGH;        /* XDCS High(SDI) */
+    VS1053_BusUnlock();
 
     return true;
 }
@@ -105,15 +275,56 @@ bool VS1053_SdiWrite(uint8_t input)
 /* SDI Tx 32 bytes */
 bool VS1053_SdiWrite32(uint8_t *input32)
 {
+    bool ok;
+
     while (HAL_GPIO_ReadPin(VS1053_DREQ_PORT, VS1053_DREQ_PIN) == GPIO_PIN_RESET)
         ; /* Wait DREQ High */
 
+    VS1053_BusLock();
     XDCS_LOW; /* XDCS Low(SDI) */
-    if (HAL_SPI_Transmit(HSPI_VS1053, input32, 32, 10) != HAL_OK)
-        return false; /* SPI Tx 32 bytes */
+    ok = HAL_SPI_Transmit(HSPI_VS1053, input32, 32, 10) == HAL_OK; /* SPI Tx 32 bytes */
     XDCS_HIGH;        /* XDCS High(SDI) */
+    VS1053_BusUnlock();
 
-    return true;
+    return ok;
+}
+
+/*
+ * SDI Tx up to 32 bytes, called from the DREQ / DMA interrupts while DREQ is high.
+ * With VS1053_USE_DMA the call returns at once and VS1053_SdiIsBusy() stays true
+ * until VS1053_SdiDmaCpltCallback(), so input must stay valid until then.
+ */
+bool VS1053_SdiStart(uint8_t *input, uint16_t len)
+{
+    bool ok;
+
+    /* Bus taken: queued, VS1053_SdiGrant() calls back when it is free */
+    if (sdiBusy || !SPI_Bus_TryAcquire(VS1053_BUS, &sdiDev))
+        return false; /* XDCS Low(SDI) on success */
+
+#if VS1053_USE_DMA
+    sdiBusy = true;
+    ok = HAL_SPI_Transmit_DMA(HSPI_VS1053, input, len) == HAL_OK;
+    if (ok)
+        return true;
+    sdiBusy = false;
+#else
+    ok = HAL_SPI_Transmit(HSPI_VS1053, input, len, 10) == HAL_OK;
+#endif
+    SPI_Bus_Release(VS1053_BUS, &sdiDev); /* XDCS High(SDI) */
+    return ok;
+}
+
+bool VS1053_SdiIsBusy(void)
+{
+    return sdiBusy;
+}
+
+/* Call from HAL_SPI_TxCpltCallback for SPI2 */
+void VS1053_SdiDmaCpltCallback(void)
+{
+    sdiBusy = false;
+    SPI_Bus_Release(VS1053_BUS, &sdiDev); /* XDCS High(SDI) */
 }
 
 /* Initialize VS1053 */
@@ -126,9 +337,8 @@ bool VS1053_Init()
     VS1053_Reset(); /* Hard Reset */
 
     /* x 1.0 Clock, 12MHz / 7, SPI Baudrate should be less than 1.75MHz */
-    (HSPI_VS1053)->Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_32; /* 42MHz / 32 = 1.31MHz */
-    if (HAL_SPI_Init(HSPI_VS1053) != HAL_OK)
-        return false;
+    SPI_Bus_SetPrescaler(VS1053_BUS, &sciDev, SPI_BAUDRATEPRESCALER_32); /* 42MHz / 32 = 1.31MHz */
+    SPI_Bus_SetPrescaler(VS1053_BUS, &sdiDev, SPI_BAUDRATEPRESCALER_32);
 
     /* Read Status to check SPI */
     if (!VS1053_SciRead(VS1053_REG_STATUS, &status))
@@ -154,9 +364,9 @@ bool VS1053_Init()
     if (!VS1053_SciWrite(VS1053_REG_CLOCKF, 0x6000))
         return false;
 
-    (HSPI_VS1053)->Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_16; /* 42MHz / 16 = 2.625MHz */
-    if (HAL_SPI_Init(HSPI_VS1053) != HAL_OK)
-        return false;
+    /* Only CR1 changes, no HAL_SPI_Init */
+    SPI_Bus_SetPrescaler(VS1053_BUS, &sciDev, SPI_BAUDRATEPRESCALER_16); /* 42MHz / 16 = 2.625MHz */
+    SPI_Bus_SetPrescaler(VS1053_BUS, &sdiDev, SPI_BAUDRATEPRESCALER_16);
 
     /* Read Status to check SPI */
     if (!VS1053_SciRead(VS1053_REG_STATUS, &status))
@@ -164,21 +374,128 @@ bool VS1053_Init()
     if (((status >> 4) & 0x0F) != 0x03)
         return false;
 
+    /* Patches are lost at every reset, load them before anything else */
+    if (!VS1053_LoadPatches())
+        return false;
+
     /* Read endFill Byte */
-    uint16_t regVal;
-    if (!VS1053_SciWrite(VS1053_REG_WRAMADDR, 0x1E06))
-        return false; /* endFill */
-    if (!VS1053_SciRead(VS1053_REG_WRAM, &regVal))
+    if (!VS1053_LoadEndFill())
         return false;
-    endFillByte = regVal & 0xFF;
 
     return true;
 }
 
+/* Plugin writes collected here and sent with VS1053_SciBatch */
+#define PLUGIN_BATCH 16
+static VS1053_SciOp pluginOps[PLUGIN_BATCH];
+static uint8_t pluginOpCount;
+
+static bool VS1053_PluginFlush(void)
+{
+    bool ok = VS1053_SciBatch(pluginOps, pluginOpCount);
+    pluginOpCount = 0;
+    return ok;
+}
+
+static bool VS1053_PluginWrite(VS1053_PluginParser *parser, uint16_t value)
+{
+    pluginOps[pluginOpCount].address = parser->addr;
+    pluginOps[pluginOpCount].value = value;
+    pluginOpCount++;
+    parser->words++;
+
+    if (pluginOpCount == PLUGIN_BATCH)
+        return VS1053_PluginFlush();
+    return true;
+}
+
+void VS1053_PluginBegin(VS1053_PluginParser *parser)
+{
+    memset(parser, 0, sizeof(*parser));
+    pluginOpCount = 0;
+}
+
+/* Records may be split anywhere between calls */
+bool VS1053_PluginFeed(VS1053_PluginParser *parser, const uint16_t *words, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint16_t word = words[i];
+
+        switch (parser->state)
+        {
+        case 0:
+            if (word > 0x0F) /* not an SCI register, wrong file */
+                return false;
+            parser->addr = word;
+            parser->state = 1;
+            break;
+
+        case 1:
+            parser->rle = (word & 0x8000) != 0;
+            parser->count = word & 0x7FFF;
+            parser->state = parser->count ? 2 : 0;
+            break;
+
+        default:
+            if (parser->rle)
+            {
+                /* One value, count times */
+                while (parser->count)
+                {
+                    parser->count--;
+                    if (!VS1053_PluginWrite(parser, word))
+                        return false;
+                }
+            }
+            else
+            {
+                parser->count--;
+                if (!VS1053_PluginWrite(parser, word))
+                    return false;
+            }
+            if (parser->count == 0)
+                parser->state = 0;
+            break;
+        }
+    }
+    return true;
+}
+
+/* Send what is left, false if the image ended inside a record */
+bool VS1053_PluginEnd(VS1053_PluginParser *parser)
+{
+    if (pluginOpCount && !VS1053_PluginFlush())
+        return false;
+    return parser->state == 0;
+}
+
+/* Load the patches linked into flash, nothing to do without VS1053_PLUGIN_FLASH */
+bool VS1053_LoadPatches()
+{
+#if VS1053_PLUGIN_FLASH
+    return VS1053_LoadPlugin(vs1053Plugin, vs1053PluginSize);
+#else
+    return true;
+#endif
+}
+
+/* Load a plugin image held in memory (flash) */
+bool VS1053_LoadPlugin(const uint16_t *plugin, uint32_t count)
+{
+    VS1053_PluginParser parser;
+
+    VS1053_PluginBegin(&parser);
+    if (!VS1053_PluginFeed(&parser, plugin, count))
+        return false;
+    return VS1053_PluginEnd(&parser);
+}
+
 /* Hard reset */
 void VS1053_Reset()
 {
 	uint8_t dummy = 0xFF;
+	sciShadowValid = 0;                                 /* registers back to defaults */
 	XRST_LOW;		                                    /* XRST Low */
 	HAL_SPI_Transmit(HSPI_VS1053, &dummy, 1, 10);       /* Tx Dummy */
 	HAL_Delay(10);										/* 10ms Delay */
@@ -233,17 +550,54 @@ bool VS1053_SetDecodeTime(uint16_t time)
 	return true;
 }
 
-/* Send endfill bytes */
-bool VS1053_SendEndFill(uint16_t num)
+/* Read endFill byte and fill the endfill buffer with it */
+bool VS1053_LoadEndFill()
 {
 	uint16_t regVal;
 	if(!VS1053_SciWrite(VS1053_REG_WRAMADDR, 0x1E06)) return false;	/* endFill */
 	if(!VS1053_SciRead(VS1053_REG_WRAM, &regVal)) return false;
 	endFillByte = regVal & 0xFF;
+	memset(endFillBuffer, endFillByte, sizeof(endFillBuffer));
+	return true;
+}
+
+/* Send one 32 byte endfill chunk if DREQ is high, never waits */
+bool VS1053_SendEndFillChunk()
+{
+	bool ok;
+
+	if (HAL_GPIO_ReadPin(VS1053_DREQ_PORT, VS1053_DREQ_PIN) == GPIO_PIN_RESET)
+		return false;
 
-	for(uint16_t i = 0; i < num; i++)
+	VS1053_BusLock();
+	XDCS_LOW; /* XDCS Low(SDI) */
+	ok = HAL_SPI_Transmit(HSPI_VS1053, endFillBuffer, sizeof(endFillBuffer), 10) == HAL_OK;
+	XDCS_HIGH; /* XDCS High(SDI) */
+	VS1053_BusUnlock();
+	return ok;
+}
+
+/* Send endfill bytes, 32 bytes per DREQ from one constant buffer */
+bool VS1053_SendEndFill(uint16_t num)
+{
+	uint16_t len;
+	bool ok = true;
+
+	/* endFillByte is read at init and by VS1053_LoadEndFill() at every stop */
+
+	VS1053_BusLock();
+	while(num > 0 && ok)
 	{
-		VS1053_SdiWrite(endFillByte);
+		len = num < sizeof(endFillBuffer) ? num : sizeof(endFillBuffer);
+
+		while (HAL_GPIO_ReadPin(VS1053_DREQ_PORT, VS1053_DREQ_PIN) == GPIO_PIN_RESET)
+			; /* Wait DREQ High */
+
+		XDCS_LOW; /* XDCS Low(SDI) */
+		ok = HAL_SPI_Transmit(HSPI_VS1053, endFillBuffer, len, 10) == HAL_OK;
+		XDCS_HIGH; /* XDCS High(SDI) */
+		num -= len;
 	}
-	return true;
+	VS1053_BusUnlock();
+	return ok;
 }
\ No newline at end of file
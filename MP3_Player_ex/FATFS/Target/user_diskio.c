@@ -36,6 +36,7 @@
 #include <string.h>
 #include "ff_gen_drv.h"
 #include "fatfs_sd.h"
+#include "sd_cache.h"
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
 
@@ -81,6 +82,7 @@ DSTATUS USER_initialize (
 )
 {
   /* USER CODE BEGIN INIT */
+    SD_Cache_Init();
     return SD_Initialize(pdrv);
   /* USER CODE END INIT */
 }
@@ -115,7 +117,7 @@ DRESULT USER_read (
 )
 {
   /* USER CODE BEGIN READ */
-    return SD_Read(pdrv, buff, sector, count);
+    return SD_Cache_Read(pdrv, buff, sector, count);
   /* USER CODE END READ */
 }
 
@@ -137,7 +139,7 @@ DRESULT USER_write (
 {
   /* USER CODE BEGIN WRITE */
   /* USER CODE HERE */
-    return SD_Write(pdrv, buff, sector, count);
+    return SD_Cache_Write(pdrv, buff, sector, count);
   /* USER CODE END WRITE */
 }
 #endif /* _USE_WRITE == 1 */
@@ -157,7 +159,7 @@ DRESULT USER_ioctl (
 )
 {
   /* USER CODE BEGIN IOCTL */
-    return SD_ioctl(pdrv, cmd, buff);
+    return SD_Cache_ioctl(pdrv, cmd, buff);
   /* USER CODE END IOCTL */
 }
 #endif /* _USE_IOCTL == 1 */
@@ -0,0 +1,194 @@
+// PC에서 fatfs_sd.c를 돌리기 위한 HAL 흉내. 시간은 실제로 흐르지 않고
+// 시뮬레이션 시각(ns)으로 센다.
+//  - SPI 바이트 하나는 8 / (PCLK2 >> (BR+1)) 초. CR1의 BR을 매번 읽으므로
+//    SD_SetPrescaler/spi_bus의 분주비 변경이 그대로 반영된다
+//  - HAL_SPI_* 호출마다 HOST_HAL_CALL_NS의 CPU 시간을 더한다
+//  - DMA 전송은 그 자리에서 끝나고 완료 콜백을 부르지만, 전송 시간은 CPU가
+//    아니라 dma_ns에 쌓는다(그동안 CPU는 다른 일을 할 수 있다)
+//  - 1 ms가 지날 때마다 SysTick처럼 HAL tick과 Timer1/Timer2를 줄인다
+#include "hal_stub.h"
+
+#include <string.h>
+
+#include "fatfs_sd.h"
+
+GPIO_TypeDef    host_gpio[5];
+SPI_TypeDef     host_spi[2];
+DWT_Type        host_dwt;
+CoreDebug_Type  host_core_debug;
+uint32_t        host_primask;
+uint32_t        SystemCoreClock = HOST_SYSCLK_HZ;
+volatile uint32_t Timer1, Timer2;
+
+SPI_HandleTypeDef hspi1;
+host_stats_t      host_stats;
+uint8_t (*host_spi1_device)(uint8_t mosi);
+
+static uint64_t now_ns;
+static uint64_t tick_ns; // 다음 ms 경계까지 남은 시간을 재기 위한 누적
+static uint32_t tick_ms;
+
+uint64_t host_now_ns(void) { return now_ns; }
+
+void host_advance_ns(uint64_t ns) {
+  now_ns += ns;
+  tick_ns += ns;
+  while (tick_ns >= 1000000u) {
+    tick_ns -= 1000000u;
+    tick_ms++;
+    if (Timer1 > 0) Timer1--;  // stm32f1xx_it.c의 SD_Timer_Handler
+    if (Timer2 > 0) Timer2--;
+  }
+  host_dwt.CYCCNT = (uint32_t)(now_ns * (HOST_SYSCLK_HZ / 1000000u) / 1000u);
+}
+
+static void cpu(uint64_t ns) {
+  host_stats.cpu_ns += ns;
+  host_advance_ns(ns);
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin,
+                       GPIO_PinState PinState) {
+  if (PinState == GPIO_PIN_SET) {
+    GPIOx->ODR |= GPIO_Pin;
+  } else {
+    GPIOx->ODR &= ~(uint32_t)GPIO_Pin;
+  }
+}
+
+uint32_t HAL_RCC_GetPCLK2Freq(void) { return HOST_PCLK2_HZ; }
+uint32_t HAL_GetTick(void) { return tick_ms; }
+
+void HAL_Delay(uint32_t Delay) { cpu((uint64_t)Delay * 1000000u); }
+
+uint32_t host_spi_hz(void) {
+  return HOST_PCLK2_HZ >> (((hspi1.Instance->CR1 & SPI_CR1_BR) >> 3) + 1);
+}
+
+/*                                   SPI                                      */
+
+HAL_StatusTypeDef HAL_SPI_Init(SPI_HandleTypeDef* hspi) {
+  hspi->Instance->CR1 = hspi->Init.BaudRatePrescaler | hspi->Init.CLKPolarity |
+                        hspi->Init.CLKPhase | SPI_CR1_SPE;
+  hspi->State = HAL_SPI_STATE_READY;
+  host_stats.spi_inits++;
+  cpu(HOST_HAL_INIT_NS);
+  return HAL_OK;
+}
+
+HAL_SPI_StateTypeDef HAL_SPI_GetState(SPI_HandleTypeDef* hspi) {
+  return hspi->State;
+}
+
+// 바이트를 실제로 주고받는다. 시간은 호출한 쪽에서 더한다
+static void exchange(SPI_HandleTypeDef* hspi, const uint8_t* tx, uint8_t* rx,
+                     uint16_t n) {
+  uint64_t byte_ns = 8000000000ull / host_spi_hz();
+
+  for (uint16_t i = 0; i < n; i++) {
+    uint8_t miso = 0xFF;
+
+    // 바이트 하나가 끝나는 시각에 카드가 다음 출력을 정하도록 먼저 시간을 민다
+    host_advance_ns(byte_ns);
+    if (hspi->Instance == SPI1 && host_spi1_device) {
+      miso = host_spi1_device(tx[i]);
+    }
+    if (rx) rx[i] = miso;
+  }
+  host_stats.bytes += n;
+}
+
+static uint64_t transfer_ns(uint16_t n) {
+  return (uint64_t)n * 8000000000ull / host_spi_hz();
+}
+
+static HAL_StatusTypeDef blocking(SPI_HandleTypeDef* hspi, const uint8_t* tx,
+                                  uint8_t* rx, uint16_t n) {
+  uint64_t t = transfer_ns(n);
+
+  if (hspi->State != HAL_SPI_STATE_READY) return HAL_BUSY;
+  host_stats.calls++;
+  if (n == 1) {
+    host_stats.byte_calls++;
+  } else {
+    host_stats.block_calls++;
+  }
+  cpu(HOST_HAL_CALL_NS);
+  host_stats.cpu_ns += t;  // 폴링 전송: 끝날 때까지 CPU가 묶인다
+  exchange(hspi, tx, rx, n);
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef* hspi,
+                                   const uint8_t* pData, uint16_t Size,
+                                   uint32_t Timeout) {
+  (void)Timeout;
+  return blocking(hspi, pData, NULL, Size);
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive(SPI_HandleTypeDef* hspi,
+                                          const uint8_t* pTxData,
+                                          uint8_t* pRxData, uint16_t Size,
+                                          uint32_t Timeout) {
+  (void)Timeout;
+  return blocking(hspi, pTxData, pRxData, Size);
+}
+
+static HAL_StatusTypeDef dma(SPI_HandleTypeDef* hspi, const uint8_t* tx,
+                             uint8_t* rx, uint16_t n) {
+  if (hspi->State != HAL_SPI_STATE_READY) return HAL_BUSY;
+  host_stats.calls++;
+  host_stats.dma_calls++;
+  cpu(HOST_HAL_CALL_NS);
+  host_stats.dma_ns += transfer_ns(n);
+  exchange(hspi, tx, rx, n);
+  if (rx) {
+    HAL_SPI_TxRxCpltCallback(hspi);
+  } else {
+    HAL_SPI_TxCpltCallback(hspi);
+  }
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef* hspi,
+                                       const uint8_t* pData, uint16_t Size) {
+  return dma(hspi, pData, NULL, Size);
+}
+
+HAL_StatusTypeDef HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef* hspi,
+                                              const uint8_t* pTxData,
+                                              uint8_t* pRxData,
+                                              uint16_t Size) {
+  return dma(hspi, pTxData, pRxData, Size);
+}
+
+HAL_StatusTypeDef HAL_SPI_Abort(SPI_HandleTypeDef* hspi) {
+  hspi->State = HAL_SPI_STATE_READY;
+  host_stats.aborts++;
+  return HAL_OK;
+}
+
+// main.c의 완료 콜백 중 SPI1(SD 카드) 부분
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef* hspi) {
+  if (hspi->Instance == SPI1) SD_SPI_DMA_CpltCallback();
+}
+
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef* hspi) {
+  if (hspi->Instance == SPI1) SD_SPI_DMA_CpltCallback();
+}
+
+// main.c의 MX_SPI1_Init: 모드 0, /4
+void host_init(void) {
+  memset(host_gpio, 0, sizeof(host_gpio));
+  memset(host_spi, 0, sizeof(host_spi));
+  memset(&host_stats, 0, sizeof(host_stats));
+  now_ns = tick_ns = 0;
+  tick_ms = 0;
+  Timer1 = Timer2 = 0;
+  hspi1.Instance = SPI1;
+  hspi1.Init.BaudRatePrescaler = SPI_BAUDRATEPRESCALER_4;
+  hspi1.Init.CLKPolarity = SPI_POLARITY_LOW;
+  hspi1.Init.CLKPhase = SPI_PHASE_1EDGE;
+  HAL_SPI_Init(&hspi1);
+  memset(&host_stats, 0, sizeof(host_stats));
+}
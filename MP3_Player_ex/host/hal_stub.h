@@ -0,0 +1,37 @@
+// hal_stub.c의 시뮬레이션 시각과 통계. 테스트가 직접 쓰는 부분만
+#ifndef HAL_STUB_H
+#define HAL_STUB_H
+
+#include <stdint.h>
+
+#include "main.h"
+
+#define HOST_SYSCLK_HZ 72000000u
+#define HOST_PCLK2_HZ 72000000u
+// HAL_SPI_* 한 번의 CPU 비용(가정): 인자 검사, 상태 전환, 레지스터 설정으로
+// 72 MHz에서 약 100 사이클. HAL_SPI_Init은 그 몇 배
+#define HOST_HAL_CALL_NS 1400u
+#define HOST_HAL_INIT_NS 5000u
+
+typedef struct {
+  uint64_t cpu_ns;        // CPU가 HAL 안에서 보낸 시간(폴링 전송 포함)
+  uint64_t dma_ns;        // DMA가 대신 보낸 시간
+  uint32_t calls;         // HAL_SPI_* 전송 호출
+  uint32_t byte_calls;    // 그중 1바이트 폴링 전송
+  uint32_t block_calls;   // 여러 바이트 폴링 전송
+  uint32_t dma_calls;
+  uint32_t spi_inits;
+  uint32_t aborts;
+  uint64_t bytes;
+} host_stats_t;
+
+extern host_stats_t host_stats;
+// SPI1에 붙은 장치: MOSI 한 바이트를 받고 같은 클럭에 나간 MISO를 돌려준다
+extern uint8_t (*host_spi1_device)(uint8_t mosi);
+
+void     host_init(void);
+uint64_t host_now_ns(void);
+void     host_advance_ns(uint64_t ns);
+uint32_t host_spi_hz(void);
+
+#endif
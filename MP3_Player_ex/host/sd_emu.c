@@ -0,0 +1,558 @@
+// SPI 모드 SD 카드 모델. 참고: SD Physical Layer Simplified Spec 7.x(SPI
+// 모드), https://elm-chan.org/docs/mmc/mmc_e.html
+#include "sd_emu.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+sd_emu_timing_t sd_emu_timing = {
+    .init_ns = 50000000,  // 50 ms
+    .read_access_ns = 200000,
+    .read_gap_ns = 20000,
+    .write_single_ns = 1500000,
+    .write_multi_ns = 300000,
+    .write_erased_ns = 150000,
+    .stop_ns = 1000000,
+    .cmd12_ns = 50000,
+    .erase_ns = 2000000,
+};
+sd_emu_stats_t sd_emu_stats;
+sd_emu_faults_t sd_emu_faults;
+
+typedef enum {
+  ST_CMD,          // 명령 대기
+  ST_READ,         // CMD17/18: 데이터 블록을 내보내는 중
+  ST_WRITE_TOKEN,  // CMD24/25: 데이터 토큰 대기
+  ST_WRITE_DATA,   // 데이터 블록 + CRC 수신 중
+} emu_state_t;
+
+static struct {
+  uint8_t* image;
+  uint32_t sectors;
+  bool sdhc;
+  GPIO_TypeDef* cs_port;
+  uint16_t cs_pin;
+
+  bool spi_mode;       // CS Low에서 CMD0을 받았다
+  uint32_t powerup;    // SPI 모드 전 CS High로 받은 클럭(바이트)
+  bool idle;
+  bool init_started;
+  uint64_t ready_at;   // ACMD41 초기화 완료 시각
+  bool app_cmd;
+  bool crc_on;
+  uint32_t pre_erase;  // ACMD23
+  uint32_t erase_start, erase_end;
+
+  emu_state_t state;
+  uint8_t cmd[6];
+  int cmd_len;
+
+  bool multi;
+  uint32_t sector;     // 다음에 읽거나 쓸 섹터
+  uint64_t data_at;    // 다음 데이터 토큰을 낼 수 있는 시각
+  bool block_out;      // 데이터 블록이 출력 큐에 있다
+  uint32_t burst;      // 이번 CMD25에서 받은 블록
+  bool rejected;       // 이번 CMD25에서 블록을 거절했다
+  uint8_t wbuf[514];
+  int wlen;
+
+  uint64_t busy_until;
+  uint8_t out[1024];   // 내보낼 바이트
+  int out_head, out_len;
+} emu;
+
+uint8_t sd_emu_crc7(const uint8_t* p, int n) {
+  uint8_t crc = 0;
+
+  for (int i = 0; i < n; i++) {
+    for (int b = 7; b >= 0; b--) {
+      int fb = ((crc >> 6) ^ (p[i] >> b)) & 1;
+
+      crc = (uint8_t)((crc << 1) & 0x7F);
+      if (fb) crc ^= 0x09;
+    }
+  }
+  return crc;
+}
+
+uint16_t sd_emu_crc16(const uint8_t* p, int n) {
+  uint16_t crc = 0;
+
+  for (int i = 0; i < n; i++) {
+    for (int b = 7; b >= 0; b--) {
+      int fb = ((crc >> 15) ^ (p[i] >> b)) & 1;
+
+      crc = (uint16_t)(crc << 1);
+      if (fb) crc ^= 0x1021;
+    }
+  }
+  return crc;
+}
+
+static void violation(const char* fmt, ...) {
+  va_list ap;
+
+  if (sd_emu_stats.violations++ == 0) {
+    va_start(ap, fmt);
+    vsnprintf(sd_emu_stats.first_violation,
+              sizeof(sd_emu_stats.first_violation), fmt, ap);
+    va_end(ap);
+  }
+}
+
+static void push(uint8_t b) {
+  if (emu.out_len == (int)sizeof(emu.out)) {
+    violation("output queue overflow");
+    return;
+  }
+  emu.out[(emu.out_head + emu.out_len++) % sizeof(emu.out)] = b;
+}
+
+static void push_block(const uint8_t* p, int n, bool bad_crc) {
+  uint16_t crc = sd_emu_crc16(p, n) ^ (bad_crc ? 0x0100 : 0);
+
+  push(0xFE);
+  for (int i = 0; i < n; i++) push(p[i]);
+  push((uint8_t)(crc >> 8));
+  push((uint8_t)crc);
+}
+
+static void clear_out(void) { emu.out_head = emu.out_len = 0; }
+
+static bool busy(void) { return host_now_ns() < emu.busy_until; }
+
+/*                                 레지스터                                   */
+
+static void make_csd(uint8_t csd[16]) {
+  memset(csd, 0, 16);
+  csd[3] = 0x32;  // TRAN_SPEED 25 Mbit/s
+  csd[5] = 0x59;  // CCC 하위, READ_BL_LEN 9
+  if (emu.sdhc) {
+    uint32_t c_size = emu.sectors / 1024 - 1;
+
+    csd[0] = 0x40;  // CSD v2
+    csd[1] = 0x0E;  // TAAC
+    csd[4] = 0x5B;  // CCC
+    csd[7] = (uint8_t)((c_size >> 16) & 0x3F);
+    csd[8] = (uint8_t)(c_size >> 8);
+    csd[9] = (uint8_t)c_size;
+    csd[10] = 0x40 | 0x3F;  // ERASE_BLK_EN, SECTOR_SIZE
+  } else {
+    // CSD v1: 섹터 수 = (C_SIZE+1) << (C_SIZE_MULT+2), C_SIZE_MULT 7
+    uint32_t c_size = emu.sectors / 512 - 1;
+    uint8_t mult = 7;
+
+    csd[1] = 0x26;
+    csd[4] = 0x5F;
+    csd[6] = (uint8_t)((c_size >> 10) & 3);
+    csd[7] = (uint8_t)(c_size >> 2);
+    csd[8] = (uint8_t)(c_size << 6);
+    csd[9] = mult >> 1;
+    csd[10] = (uint8_t)((mult & 1) << 7) | 0x40 | 0x3F;
+  }
+  csd[11] = 0x80;
+  csd[12] = 0x0A;
+  csd[13] = 0x40;
+  csd[15] = (uint8_t)(sd_emu_crc7(csd, 15) << 1 | 1);
+}
+
+static void make_cid(uint8_t cid[16]) {
+  static const uint8_t base[15] = {0x03, 'S', 'D', 'E', 'M', 'U', '0', '1',
+                                   0x10, 0x12, 0x34, 0x56, 0x78, 0x01, 0x6A};
+
+  memcpy(cid, base, 15);
+  cid[15] = (uint8_t)(sd_emu_crc7(cid, 15) << 1 | 1);
+}
+
+// SD Status: AU_SIZE 9(4 MiB)
+static void make_sd_status(uint8_t st[64]) {
+  memset(st, 0, 64);
+  st[8] = 0x04;  // SPEED_CLASS 10
+  st[10] = 0x90;
+}
+
+static void push_register(const uint8_t* p, int n) {
+  push(0xFF);  // 토큰 전 대기(Nac)
+  push(0xFF);
+  push_block(p, n, false);
+}
+
+/*                                   명령                                     */
+
+// 주소 인자를 섹터로. 틀리면 R1 오류 비트
+static uint8_t to_sector(uint32_t arg, uint32_t* sector) {
+  if (!emu.sdhc) {
+    if (arg % 512) return 0x20;  // ADDRESS_ERROR
+    arg /= 512;
+  }
+  if (arg >= emu.sectors) return 0x40;  // PARAMETER_ERROR(out of range)
+  *sector = arg;
+  return 0;
+}
+
+static void respond(uint8_t r1) {
+  push(0xFF);  // Ncr
+  push(r1);
+}
+
+static void execute(void) {
+  uint8_t idx = emu.cmd[0] & 0x3F;
+  uint32_t arg = (uint32_t)emu.cmd[1] << 24 | (uint32_t)emu.cmd[2] << 16 |
+                 (uint32_t)emu.cmd[3] << 8 | emu.cmd[4];
+  bool app = emu.app_cmd;
+  uint8_t r1 = emu.idle ? 0x01 : 0x00;
+  uint8_t reg[64], err;
+
+  emu.app_cmd = false;
+  if (!emu.spi_mode) {
+    if (idx != 0) {
+      violation("CMD%u before CMD0", idx);
+      return;
+    }
+    if (emu.powerup < 10) {
+      violation("CMD0 after only %u bytes of power-up clocks", emu.powerup);
+    }
+  }
+
+  // CMD0/CMD8은 CRC 모드와 상관없이 검사한다
+  if ((emu.crc_on || idx == 0 || idx == 8) &&
+      emu.cmd[5] != (uint8_t)(sd_emu_crc7(emu.cmd, 5) << 1 | 1)) {
+    sd_emu_stats.crc7_errors++;
+    respond(r1 | 0x08);
+    return;
+  }
+
+  if (emu.state == ST_READ) {
+    if (idx != 12) violation("CMD%u during a data read", idx);
+    emu.state = ST_CMD;
+  }
+  if (app) {
+    sd_emu_stats.acmds[idx]++;
+  } else {
+    sd_emu_stats.cmds[idx]++;
+  }
+
+  if (app && idx == 41) {
+    if (!emu.init_started) {
+      emu.init_started = true;
+      emu.ready_at = host_now_ns() + sd_emu_timing.init_ns;
+    }
+    // SDHC는 HCS 없이는 초기화되지 않는다
+    if (host_now_ns() >= emu.ready_at && (!emu.sdhc || (arg & (1u << 30)))) {
+      emu.idle = false;
+    }
+    respond(emu.idle ? 0x01 : 0x00);
+    return;
+  }
+  if (app && idx == 13) {
+    push(0xFF);
+    push(r1);
+    push(0x00);  // R2 두 번째 바이트
+    make_sd_status(reg);
+    push_register(reg, 64);
+    return;
+  }
+  if (app && idx == 23) {
+    emu.pre_erase = arg & 0x7FFFFF;
+    respond(r1);
+    return;
+  }
+  if (app) {
+    respond(r1 | 0x04);
+    return;
+  }
+
+  switch (idx) {
+    case 0:
+      emu.spi_mode = true;
+      emu.idle = true;
+      emu.crc_on = false;
+      emu.init_started = false;
+      respond(0x01);
+      return;
+    case 1:
+      respond(r1);
+      return;
+    case 8:
+      respond(r1);
+      push(0x00);
+      push(0x00);
+      push((uint8_t)((arg >> 8) & 0x0F));
+      push((uint8_t)arg);
+      return;
+    case 55:
+      emu.app_cmd = true;
+      respond(r1);
+      return;
+    case 58:
+      respond(r1);
+      push((emu.idle ? 0x00 : 0x80) | (!emu.idle && emu.sdhc ? 0x40 : 0x00));
+      push(0xFF);
+      push(0x80);
+      push(0x00);
+      return;
+    case 59:
+      emu.crc_on = arg & 1;
+      respond(r1);
+      return;
+    case 16:
+      respond(r1 | (arg == 512 ? 0x00 : 0x40));
+      return;
+    case 12:
+      // 바로 다음 바이트는 stuff byte(나가던 데이터), 그 뒤에 R1b
+      {
+        uint8_t stuff = emu.out_len ? emu.out[emu.out_head] : 0xFF;
+
+        clear_out();
+        emu.block_out = false;
+        push(stuff);
+        respond(r1);
+        emu.busy_until = host_now_ns() + sd_emu_timing.cmd12_ns;
+      }
+      return;
+  }
+
+  if (emu.idle) {
+    respond(r1 | 0x04);
+    return;
+  }
+
+  switch (idx) {
+    case 9:
+    case 10:
+      respond(r1);
+      if (idx == 9) {
+        make_csd(reg);
+      } else {
+        make_cid(reg);
+      }
+      push_register(reg, 16);
+      return;
+    case 17:
+    case 18:
+      err = to_sector(arg, &emu.sector);
+      respond(r1 | err);
+      if (err) return;
+      emu.state = ST_READ;
+      emu.multi = idx == 18;
+      emu.block_out = false;
+      emu.data_at = host_now_ns() + sd_emu_timing.read_access_ns;
+      return;
+    case 24:
+    case 25:
+      err = to_sector(arg, &emu.sector);
+      respond(r1 | err);
+      if (err) return;
+      emu.state = ST_WRITE_TOKEN;
+      emu.multi = idx == 25;
+      emu.burst = 0;
+      emu.rejected = false;
+      if (!emu.multi) emu.pre_erase = 0;
+      return;
+    case 32:
+    case 33:
+      err = to_sector(arg, idx == 32 ? &emu.erase_start : &emu.erase_end);
+      respond(r1 | err);
+      return;
+    case 38:
+      if (emu.erase_end < emu.erase_start) {
+        respond(r1 | 0x10);  // ERASE_SEQUENCE_ERROR
+        return;
+      }
+      memset(emu.image + (size_t)emu.erase_start * 512, 0,
+             (size_t)(emu.erase_end - emu.erase_start + 1) * 512);
+      respond(r1);
+      emu.busy_until = host_now_ns() + sd_emu_timing.erase_ns;
+      return;
+    default:
+      respond(r1 | 0x04);
+      return;
+  }
+}
+
+/*                                  데이터                                    */
+
+// CMD17/18: 지연이 지났으면 다음 블록을 큐에 넣는다
+static void read_next(void) {
+  if (emu.sector >= emu.sectors || sd_emu_faults.read_token) {
+    if (sd_emu_faults.read_token) sd_emu_faults.read_token--;
+    push(emu.sector >= emu.sectors ? 0x08 : 0x04);  // out of range / ECC
+    emu.state = ST_CMD;
+    return;
+  }
+  push_block(emu.image + (size_t)emu.sector * 512, 512,
+             sd_emu_faults.read_crc > 0);
+  if (sd_emu_faults.read_crc) sd_emu_faults.read_crc--;
+  sd_emu_stats.blocks_read++;
+  emu.sector++;
+  emu.block_out = true;
+}
+
+static void end_burst(void) {
+  sd_emu_stats.multi_writes++;
+  if (emu.burst > sd_emu_stats.longest_burst) {
+    sd_emu_stats.longest_burst = emu.burst;
+  }
+  emu.pre_erase = 0;
+}
+
+static void write_token(uint8_t mosi) {
+  if (mosi == 0xFF) return;
+  if (busy()) {
+    violation("token 0x%02X while busy", mosi);
+    return;
+  }
+  if (emu.multi && mosi == 0xFD) {
+    push(0xFF);  // busy는 1바이트 뒤부터
+    emu.busy_until = host_now_ns() + sd_emu_timing.stop_ns;
+    emu.state = ST_CMD;
+    end_burst();
+    return;
+  }
+  if (mosi == (emu.multi ? 0xFC : 0xFE)) {
+    if (emu.rejected) violation("data block after a rejected block");
+    emu.state = ST_WRITE_DATA;
+    emu.wlen = 0;
+    return;
+  }
+  if ((mosi & 0xC0) == 0x40) {
+    violation("CMD%u instead of a data token", mosi & 0x3F);
+    if (emu.multi) end_burst();
+    emu.state = ST_CMD;
+    emu.cmd[0] = mosi;
+    emu.cmd_len = 1;
+    return;
+  }
+  violation("unexpected byte 0x%02X instead of a data token", mosi);
+}
+
+static void write_block(void) {
+  uint16_t got = (uint16_t)(emu.wbuf[512] << 8 | emu.wbuf[513]);
+  uint32_t ns;
+  uint8_t resp;
+
+  if (emu.crc_on && got != sd_emu_crc16(emu.wbuf, 512)) {
+    sd_emu_stats.crc16_errors++;
+    resp = 0x0B;
+  } else if (sd_emu_faults.write_crc) {
+    sd_emu_faults.write_crc--;
+    resp = 0x0B;
+  } else if (sd_emu_faults.write_error || emu.sector >= emu.sectors) {
+    if (sd_emu_faults.write_error) sd_emu_faults.write_error--;
+    resp = 0x0D;
+  } else {
+    memcpy(emu.image + (size_t)emu.sector * 512, emu.wbuf, 512);
+    sd_emu_stats.blocks_written++;
+    resp = 0x05;
+  }
+  push(0xE0 | resp);  // 위 3비트는 정해져 있지 않다
+
+  if (!emu.multi) {
+    ns = sd_emu_timing.write_single_ns;
+  } else if (emu.pre_erase > emu.burst) {
+    ns = sd_emu_timing.write_erased_ns;
+    sd_emu_stats.pre_erased++;
+  } else {
+    ns = sd_emu_timing.write_multi_ns;
+  }
+  emu.busy_until = host_now_ns() + (resp == 0x05 ? ns : 0);
+
+  if (resp != 0x05) emu.rejected = true;
+  emu.sector++;
+  emu.burst++;
+  emu.state = emu.multi ? ST_WRITE_TOKEN : ST_CMD;
+}
+
+/*                                  SPI 바이트                                */
+
+uint8_t sd_emu_xfer(uint8_t mosi) {
+  uint8_t miso;
+
+  if (emu.cs_port->ODR & emu.cs_pin) {
+    // 선택되지 않았으면 MISO를 놓는다(풀업)
+    if (!emu.spi_mode) emu.powerup++;
+    if (emu.state == ST_WRITE_DATA) {
+      violation("CS high in the middle of a data block");
+    }
+    emu.cmd_len = 0;
+    return 0xFF;
+  }
+
+  // 이 클럭에 나가는 바이트
+  if (emu.state == ST_READ && emu.out_len == 0 && !emu.block_out &&
+      host_now_ns() >= emu.data_at) {
+    read_next();
+  }
+  if (emu.out_len) {
+    miso = emu.out[emu.out_head];
+    emu.out_head = (emu.out_head + 1) % sizeof(emu.out);
+    emu.out_len--;
+    if (emu.out_len == 0 && emu.block_out) {
+      // 블록 하나를 다 내보냈다
+      emu.block_out = false;
+      if (emu.multi) {
+        emu.data_at = host_now_ns() + sd_emu_timing.read_gap_ns;
+      } else {
+        emu.state = ST_CMD;
+      }
+    }
+  } else if (busy()) {
+    miso = 0x00;
+  } else {
+    miso = 0xFF;
+  }
+
+  // 들어온 바이트
+  switch (emu.state) {
+    case ST_WRITE_TOKEN:
+      write_token(mosi);
+      break;
+    case ST_WRITE_DATA:
+      emu.wbuf[emu.wlen++] = mosi;
+      if (emu.wlen == 514) write_block();
+      break;
+    case ST_CMD:
+    case ST_READ:
+      if (emu.cmd_len == 0 && (mosi & 0xC0) != 0x40) break;
+      if (emu.cmd_len == 0 && busy() && emu.out_len == 0) {
+        violation("CMD%u while busy", mosi & 0x3F);
+      }
+      emu.cmd[emu.cmd_len++] = mosi;
+      if (emu.cmd_len == 6) {
+        emu.cmd_len = 0;
+        execute();
+      }
+      break;
+  }
+  return miso;
+}
+
+/*                                    설정                                    */
+
+void sd_emu_init(uint32_t sectors, bool sdhc, GPIO_TypeDef* cs_port,
+                 uint16_t cs_pin) {
+  free(emu.image);
+  memset(&emu, 0, sizeof(emu));
+  emu.image = malloc((size_t)sectors * 512);
+  emu.sectors = sectors;
+  emu.sdhc = sdhc;
+  emu.cs_port = cs_port;
+  emu.cs_pin = cs_pin;
+  emu.idle = true;
+  for (uint32_t s = 0; s < sectors; s++) {
+    for (int i = 0; i < 512; i += 4) {
+      uint32_t v = s * 0x9E3779B1u ^ (uint32_t)i * 0x85EBCA6Bu;
+
+      memcpy(emu.image + (size_t)s * 512 + i, &v, 4);
+    }
+  }
+  memset(&sd_emu_faults, 0, sizeof(sd_emu_faults));
+  sd_emu_reset_stats();
+}
+
+uint8_t* sd_emu_image(void) { return emu.image; }
+uint32_t sd_emu_sectors(void) { return emu.sectors; }
+
+void sd_emu_reset_stats(void) { memset(&sd_emu_stats, 0, sizeof(sd_emu_stats)); }
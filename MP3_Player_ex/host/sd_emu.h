@@ -0,0 +1,69 @@
+// SPI 모드 SD 카드 모델. hal_stub의 SPI1에 붙어서 바이트 단위로 명령을 받고
+// 응답, 데이터 블록, busy를 내보낸다. 메모리 이미지 위에서 읽고 쓰며,
+// 시간이 걸리는 동작(토큰 지연, 프로그래밍 busy, 초기화)은 hal_stub의
+// 시뮬레이션 시각으로 잰다.
+//
+// 드라이버가 SPI 프로토콜을 어기면(busy 중 명령, CMD18 도중 다른 명령, 데이터
+// 블록 도중 CS High 등) violations에 세고 첫 메시지를 남긴다.
+#ifndef SD_EMU_H
+#define SD_EMU_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hal_stub.h"
+
+// 지연 시간(가정). 실측값이 아니라 Class 10 카드 데이터시트 수준의 모델이므로
+// 벤치 결과는 드라이버 오버헤드와 이 값들의 조합으로 읽는다
+typedef struct {
+  uint32_t init_ns;          // 첫 ACMD41부터 준비 완료까지
+  uint32_t read_access_ns;   // CMD17/18 후 첫 데이터 토큰까지
+  uint32_t read_gap_ns;      // CMD18의 블록 사이
+  uint32_t write_single_ns;  // CMD24 블록의 프로그래밍 busy
+  uint32_t write_multi_ns;   // CMD25 블록의 busy
+  uint32_t write_erased_ns;  // ACMD23으로 미리 지운 CMD25 블록의 busy
+  uint32_t stop_ns;          // Stop Tran 토큰 뒤 busy
+  uint32_t cmd12_ns;         // CMD12 뒤 busy
+  uint32_t erase_ns;         // CMD38 busy
+} sd_emu_timing_t;
+
+typedef struct {
+  uint32_t cmds[64];        // 명령 번호별 횟수(ACMD 제외)
+  uint32_t acmds[64];
+  uint32_t blocks_read;     // 내보낸 데이터 블록(레지스터 제외)
+  uint32_t blocks_written;  // 받아들인 블록
+  uint32_t multi_writes;    // 끝난 CMD25 수
+  uint32_t longest_burst;   // 가장 긴 CMD25(블록)
+  uint32_t pre_erased;      // ACMD23 덕분에 빨리 쓴 블록
+  uint32_t crc7_errors;     // 카드가 거절한 명령 CRC
+  uint32_t crc16_errors;    // 카드가 거절한 데이터 CRC
+  uint32_t violations;
+  char     first_violation[160];
+} sd_emu_stats_t;
+
+// 다음 n개의 블록에 넣을 오류
+typedef struct {
+  uint32_t read_crc;     // 보내는 블록의 CRC16을 틀리게
+  uint32_t read_token;   // 데이터 토큰 대신 오류 토큰(ECC failed)
+  uint32_t write_crc;    // 받은 블록을 CRC 오류(0x0B)로 거절
+  uint32_t write_error;  // 받은 블록을 쓰기 오류(0x0D)로 거절
+} sd_emu_faults_t;
+
+extern sd_emu_timing_t sd_emu_timing;
+extern sd_emu_stats_t  sd_emu_stats;
+extern sd_emu_faults_t sd_emu_faults;
+
+// sectors는 1024의 배수(CSD C_SIZE 단위 512 KiB). sdhc가 false면 바이트
+// 주소를 쓰는 SDSC(CSD v1)로 동작한다. 이미지는 섹터 번호로 채운 패턴
+void     sd_emu_init(uint32_t sectors, bool sdhc, GPIO_TypeDef* cs_port,
+                     uint16_t cs_pin);
+uint8_t* sd_emu_image(void);
+uint32_t sd_emu_sectors(void);
+void     sd_emu_reset_stats(void);
+uint8_t  sd_emu_xfer(uint8_t mosi);
+
+// 카드 쪽 CRC. 드라이버의 것과 따로 구현한다
+uint8_t  sd_emu_crc7(const uint8_t* p, int n);
+uint16_t sd_emu_crc16(const uint8_t* p, int n);
+
+#endif
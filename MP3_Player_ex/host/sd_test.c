@@ -0,0 +1,850 @@
+// PC에서 SD 카드 경로(user_diskio.c → sd_cache.c → sd_prefetch.c → fatfs_sd.c
+// → spi_bus.c)를 펌웨어 소스 그대로 빌드해서 sd_emu.c의 카드 모델 위에서
+// 돌린다. MicroSD_FATFS_ex의 같은 파일들(버스 없음, DMA 없음)도 같은 검사로
+// 빌드한다. FatFs(ff.c)는 이 트리에 없으므로 FatFs가 부르는 diskio 계층
+// (USER_Driver)부터 시험한다. 카드 모델이 프로토콜 위반을 세므로 모든 검사는
+// 위반 0도 함께 본다.
+//
+//   sd_test        : 모든 검사, 하나라도 틀리면 실패로 끝난다
+//   sd_test bench  : 시뮬레이션 시각으로 잰 처리량과 CPU 시간. 카드 지연은
+//                    sd_emu.c의 가정값이라 절대값보다 방식 간 비교로 읽는다
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fatfs_sd.h"
+#include "ff_gen_drv.h"
+#include "hal_stub.h"
+#include "sd_cache.h"
+#include "sd_emu.h"
+#include "sd_prefetch.h"
+#include "user_diskio.h"
+#if SD_USE_SPI_BUS
+#include "spi_bus.h"
+#endif
+
+// MicroSD_FATFS_ex의 main.h는 CS 핀 이름이 다르다
+#ifndef SD_CS_Pin
+#define SD_CS_Pin CS_Pin
+#define SD_CS_GPIO_Port CS_GPIO_Port
+#endif
+
+#define SECTORS 16384  // 8 MiB
+
+static int failures;
+
+static bool check(bool ok, const char* fmt, ...) {
+  va_list ap;
+
+  printf("  ");
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  printf("%s\n", ok ? "" : "  FAIL");
+  if (!ok) failures++;
+  return ok;
+}
+
+static bool clean(void) {
+  return check(sd_emu_stats.violations == 0, "protocol violations: %u %s",
+               sd_emu_stats.violations, sd_emu_stats.first_violation);
+}
+
+// 전원을 넣고 main.c 순서대로 SPI1, 버스, 카드를 초기화한다
+static DSTATUS card(bool sdhc) {
+  host_init();
+  sd_emu_init(SECTORS, sdhc, SD_CS_GPIO_Port, SD_CS_Pin);
+  host_spi1_device = sd_emu_xfer;
+  HAL_GPIO_WritePin(SD_CS_GPIO_Port, SD_CS_Pin, GPIO_PIN_SET);
+#if SD_USE_SPI_BUS
+  SPI_Bus_Init(&spiBus1, &hspi1);
+#endif
+  return USER_Driver.disk_initialize(0);
+}
+
+static const uint8_t* image(DWORD sector) {
+  return sd_emu_image() + (size_t)sector * 512;
+}
+
+static void pattern(uint8_t* p, UINT count, uint32_t seed) {
+  for (UINT i = 0; i < count * 512; i++) {
+    seed = seed * 1103515245u + 12345u;
+    p[i] = (uint8_t)(seed >> 16);
+  }
+}
+
+// 구간 측정: 시뮬레이션 시각과 HAL 통계의 차이
+static uint64_t mark_ns;
+static host_stats_t mark_stats;
+
+static void mark(void) {
+  mark_ns = host_now_ns();
+  mark_stats = host_stats;
+}
+
+static double since_s(void) { return (host_now_ns() - mark_ns) / 1e9; }
+
+/*                                 초기화                                    */
+
+static void test_init(void) {
+  DSTATUS st;
+  uint64_t t;
+
+  printf("init (SDHC):\n");
+  st = card(true);
+  t = host_now_ns();
+  check(st == 0, "disk_initialize = 0x%02X", st);
+  check(SD_GetVersion() == SD_TYPE_V2_BLOCK_ADDRESS, "block-addressed v2 card");
+  check(SD_GetClock() == 18000000, "clock %lu Hz (TRAN_SPEED 25 MHz, SPI max 18)",
+        (unsigned long)SD_GetClock());
+  check(host_spi_hz() == 18000000, "SPI1 runs at the negotiated clock");
+  check(t >= sd_emu_timing.init_ns, "took %.1f ms (ACMD41 busy %.0f ms)",
+        t / 1e6, sd_emu_timing.init_ns / 1e6);
+  check(sd_emu_stats.cmds[16] == 0, "no CMD16 for a block-addressed card");
+  clean();
+
+  printf("init (SDSC, byte addresses):\n");
+  st = card(false);
+  check(st == 0, "disk_initialize = 0x%02X", st);
+  check(SD_GetVersion() == SD_TYPE_V2_BYTE_ADDRESS, "byte-addressed v2 card");
+  check(sd_emu_stats.cmds[16] == 1, "CMD16(512) sent");
+  clean();
+}
+
+/*                                읽기/쓰기                                  */
+
+static void roundtrip(bool sdhc) {
+  static uint8_t w[16 * 512], r[16 * 512];
+  const DWORD base = 5000;
+  DRESULT res;
+
+  printf("roundtrip (%s):\n", sdhc ? "SDHC" : "SDSC");
+  card(sdhc);
+  pattern(w, 16, base);
+
+  res = USER_Driver.disk_write(0, w, base, 16);
+  check(res == RES_OK && memcmp(image(base), w, 16 * 512) == 0,
+        "16-sector write lands on the card");
+  res = USER_Driver.disk_write(0, w, base + 100, 1);
+  check(res == RES_OK, "1-sector write");
+  memset(r, 0, sizeof(r));
+  res = USER_Driver.disk_read(0, r, base, 16);
+  check(res == RES_OK && memcmp(r, w, 16 * 512) == 0, "16-sector read back");
+  memset(r, 0, sizeof(r));
+  res = USER_Driver.disk_read(0, r, base + 100, 1);
+  check(res == RES_OK && memcmp(r, w, 512) == 0, "1-sector read back");
+  res = USER_Driver.disk_read(0, r, SECTORS - 1, 1);
+  check(res == RES_OK && memcmp(r, image(SECTORS - 1), 512) == 0,
+        "last sector");
+  res = USER_Driver.disk_read(0, r, SECTORS, 1);
+  check(res == RES_ERROR, "past the end -> RES_ERROR");
+  clean();
+}
+
+// CMD18: 블록 수와 위치를 바꿔 가며 바이트 단위로 비교. 요청 하나에 CMD18
+// 하나와 CMD12 하나, 1섹터는 CMD17
+static void test_multi_read(void) {
+  static const struct {
+    DWORD sector;
+    UINT count;
+  } runs[] = {{0, 2}, {77, 3}, {1000, 8}, {4095, 64}, {9000, 128},
+              {SECTORS - 128, 128}, {SECTORS - 1, 1}};
+  static uint8_t r[129 * 512];
+  bool exact = true, cmds = true;
+  DRESULT res;
+
+  printf("multi-block read (CMD18):\n");
+  card(true);
+  for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+    UINT n = runs[i].count;
+
+    sd_emu_reset_stats();
+    memset(r, 0xA5, sizeof(r));
+    res = SD_Read(0, r, runs[i].sector, n);
+    exact &= res == RES_OK && memcmp(r, image(runs[i].sector), n * 512) == 0 &&
+             r[n * 512] == 0xA5;
+    cmds &= n > 1 ? sd_emu_stats.cmds[18] == 1 && sd_emu_stats.cmds[12] == 1 &&
+                        sd_emu_stats.cmds[17] == 0
+                  : sd_emu_stats.cmds[17] == 1 && sd_emu_stats.cmds[12] == 0;
+    cmds &= sd_emu_stats.blocks_read == n;
+  }
+  check(exact, "2..128 sectors byte-exact, nothing written past the buffer");
+  check(cmds, "one CMD18 + CMD12 per request (CMD17 for one sector), no extra blocks");
+  clean();
+
+  // 끝을 넘는 CMD18은 오류 토큰을 받고 멈춘다. 다음 요청은 정상이어야 한다
+  sd_emu_reset_stats();
+  res = SD_Read(0, r, SECTORS - 2, 4);
+  check(res == RES_ERROR, "run past the last sector -> RES_ERROR");
+  sd_emu_faults.read_token = 1;
+  res = SD_Read(0, r, 100, 8);
+  check(res == RES_ERROR, "error token (ECC failed) -> RES_ERROR");
+  res = SD_Read(0, r, 100, 8);
+  check(res == RES_OK && memcmp(r, image(100), 8 * 512) == 0,
+        "next read after the errors is clean");
+  clean();
+
+  // 연속 읽기: CMD17을 섹터마다 보내는 것보다 버스 속도에 가까워야 한다
+  {
+    const UINT total = 2048;  // 1 MiB
+    double bus = host_spi_hz() / 8.0, single, multi;
+
+    mark();
+    for (UINT s = 0; s < total; s++) SD_Read(0, r, 2000 + s, 1);
+    single = total * 512 / since_s();
+    mark();
+    for (UINT s = 0; s < total; s += 128) SD_Read(0, r, 2000 + s, 128);
+    multi = total * 512 / since_s();
+    check(multi > 0.8 * bus && multi > 1.5 * single,
+          "1 MiB: CMD18x128 %.0f KB/s (%.0f%% of the %.2f MHz bus), "
+          "CMD17 %.0f KB/s",
+          multi / 1e3, 100 * multi / bus, host_spi_hz() / 1e6, single / 1e3);
+    clean();
+  }
+}
+
+// CMD25: ACMD23으로 블록 수를 알린 뒤 한 번에 쓰고, 거절된 블록은 오류로
+// 돌아와야 한다
+static void test_multi_write(void) {
+  static const struct {
+    DWORD sector;
+    UINT count;
+  } runs[] = {{10, 2}, {301, 3}, {1024, 8}, {3001, 64}, {7000, 128},
+              {SECTORS - 128, 128}, {50, 1}};
+  static uint8_t w[128 * 512], before[128 * 512];
+  const uint8_t* blocks[4];
+  bool exact = true, cmds = true;
+  DRESULT res;
+
+  printf("multi-block write (CMD25):\n");
+  card(true);
+  for (size_t i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+    DWORD sec = runs[i].sector;
+    UINT n = runs[i].count;
+    uint8_t prev[512], next[512];
+
+    pattern(w, n, sec);
+    memcpy(prev, image(sec - 1), 512);
+    if (sec + n < SECTORS) memcpy(next, image(sec + n), 512);
+    sd_emu_reset_stats();
+    res = SD_Write(0, w, sec, n);
+    exact &= res == RES_OK && memcmp(image(sec), w, n * 512) == 0 &&
+             memcmp(image(sec - 1), prev, 512) == 0 &&
+             (sec + n == SECTORS || memcmp(image(sec + n), next, 512) == 0);
+    cmds &= n > 1 ? sd_emu_stats.cmds[25] == 1 && sd_emu_stats.acmds[23] == 1 &&
+                        sd_emu_stats.pre_erased == n &&
+                        sd_emu_stats.multi_writes == 1
+                  : sd_emu_stats.cmds[24] == 1 && sd_emu_stats.acmds[23] == 0;
+    cmds &= sd_emu_stats.blocks_written == n;
+  }
+  check(exact, "2..128 sectors land exactly, neighbours untouched");
+  check(cmds, "ACMD23(n) + one CMD25 per request (CMD24 for one sector)");
+
+  // 흩어진 버퍼(sd_cache가 dirty 섹터를 모아 쓸 때)
+  pattern(w, 4, 99);
+  for (int i = 0; i < 4; i++) blocks[3 - i] = &w[i * 512];
+  res = SD_WriteBlocks(0, blocks, 2222, 4);
+  check(res == RES_OK && memcmp(image(2222), &w[3 * 512], 512) == 0 &&
+            memcmp(image(2225), w, 512) == 0,
+        "SD_WriteBlocks writes scattered buffers in order");
+  clean();
+
+  // 오류 전파: 거절된 블록 뒤로는 보내지 않고 Stop Tran으로 끝낸다
+  pattern(w, 8, 7);
+  memcpy(before, image(4000), 8 * 512);
+  sd_emu_reset_stats();
+  sd_emu_faults.write_error = 1;
+  res = SD_Write(0, w, 4000, 8);
+  check(res == RES_ERROR && sd_emu_stats.blocks_written == 0 &&
+            memcmp(image(4000), before, 8 * 512) == 0,
+        "write error on the first block -> RES_ERROR, rest not sent");
+  sd_emu_faults.write_error = 1;
+  res = SD_Write(0, w, 4000, 1);
+  check(res == RES_ERROR, "write error on CMD24 -> RES_ERROR");
+  res = SD_Write(0, w, SECTORS - 2, 4);
+  check(res == RES_ERROR && memcmp(image(SECTORS - 2), w, 2 * 512) == 0,
+        "run past the last sector -> RES_ERROR after the 2 that fit");
+  res = SD_Write(0, w, SECTORS, 2);
+  check(res == RES_ERROR, "start past the last sector -> RES_ERROR");
+  res = SD_Write(0, w, 4000, 8);
+  check(res == RES_OK && memcmp(image(4000), w, 8 * 512) == 0,
+        "next write after the errors is clean");
+  clean();
+}
+
+/*                                   CRC                                     */
+
+// CMD59 뒤에는 카드가 모든 명령의 CRC7과 쓰는 블록의 CRC16을 검사하므로,
+// 카드가 거절하지 않으면 드라이버의 계산이 맞다. 틀린 블록은 다시 요청한다
+static void test_crc(void) {
+  static uint8_t w[64 * 512], r[64 * 512];
+  static const uint8_t ff[512] = {[0 ... 511] = 0xFF};
+  SD_CRC_Stats st;
+  DRESULT res;
+  bool ok;
+
+  printf("CRC mode (CMD59):\n");
+  card(true);
+  check(sd_emu_crc16(ff, 512) == 0x7FA1, "card model CRC16(512 x 0xFF) = 0x7FA1");
+  sd_emu_reset_stats();
+  ok = SD_SetCRC(true);
+  check(ok && SD_IsCRCEnabled() && sd_emu_stats.cmds[59] == 1,
+        "SD_SetCRC(true) -> CMD59(1)");
+
+  pattern(w, 64, 59);
+  SD_ResetCRCStats();
+  res = SD_Write(0, w, 5000, 64);
+  ok = res == RES_OK && SD_Read(0, r, 5000, 64) == RES_OK &&
+       SD_Read(0, r + 512, 5001, 1) == RES_OK;
+  SD_GetCRCStats(&st);
+  check(ok && memcmp(image(5000), w, 64 * 512) == 0 &&
+            memcmp(r, w, 512) == 0 && memcmp(r + 512, w + 512, 63 * 512) == 0,
+        "64-sector write + read back with CRC on");
+  check(sd_emu_stats.crc7_errors == 0 && sd_emu_stats.crc16_errors == 0,
+        "card accepted every CRC7 and CRC16 (%u, %u rejected)",
+        (unsigned)sd_emu_stats.crc7_errors, (unsigned)sd_emu_stats.crc16_errors);
+  check(st.blocks == 129 && st.errors == 0 && st.retries == 0,
+        "%u blocks checked, %u errors", (unsigned)st.blocks,
+        (unsigned)st.errors);
+  clean();
+
+  // 한두 번 틀리면 그 블록부터 다시 읽고 쓴다
+  SD_ResetCRCStats();
+  sd_emu_faults.read_crc = 2;
+  res = SD_Read(0, r, 5000, 16);
+  SD_GetCRCStats(&st);
+  check(res == RES_OK && memcmp(r, w, 16 * 512) == 0 && st.errors == 2 &&
+            st.retries == 2,
+        "2 bad read CRCs in CMD18 -> %u retries, data exact",
+        (unsigned)st.retries);
+  sd_emu_faults.read_crc = 1;
+  res = SD_Read(0, r, 5020, 1);
+  check(res == RES_OK && memcmp(r, w + 20 * 512, 512) == 0,
+        "bad read CRC in CMD17 -> retried");
+  SD_ResetCRCStats();
+  pattern(w, 16, 60);
+  sd_emu_faults.write_crc = 2;
+  res = SD_Write(0, w, 5000, 16);
+  SD_GetCRCStats(&st);
+  check(res == RES_OK && memcmp(image(5000), w, 16 * 512) == 0 &&
+            st.errors == 2 && st.retries == 2,
+        "2 write CRC rejections in CMD25 -> %u retries, image exact",
+        (unsigned)st.retries);
+  clean();
+
+  // SD_CRC_RETRIES번 넘게 틀리면 오류
+  sd_emu_faults.read_crc = SD_CRC_RETRIES + 1;
+  res = SD_Read(0, r, 5000, 4);
+  sd_emu_faults.read_crc = 0;
+  check(res == RES_ERROR, "read CRC wrong %d times -> RES_ERROR",
+        SD_CRC_RETRIES + 1);
+  sd_emu_faults.write_crc = SD_CRC_RETRIES + 1;
+  res = SD_Write(0, w, 5000, 4);
+  sd_emu_faults.write_crc = 0;
+  check(res == RES_ERROR, "write CRC rejected %d times -> RES_ERROR",
+        SD_CRC_RETRIES + 1);
+  res = SD_Read(0, r, 5000, 16);
+  check(res == RES_OK && memcmp(r, w, 16 * 512) == 0,
+        "next read after the errors is clean");
+  clean();
+
+  // 끄면 CRC를 보지 않는다
+  ok = SD_SetCRC(false);
+  SD_ResetCRCStats();
+  res = SD_Read(0, r, 5000, 16);
+  SD_GetCRCStats(&st);
+  check(ok && !SD_IsCRCEnabled() && res == RES_OK && st.blocks == 0,
+        "SD_SetCRC(false) -> CMD59(0), blocks no longer checked");
+  clean();
+}
+
+/*                                  ioctl                                    */
+
+static void test_ioctl(void) {
+  uint8_t reg[16], r[512], zero[512] = {0};
+  DWORD n = 0, range[2];
+  WORD ss = 0;
+  DRESULT res;
+
+  printf("ioctl:\n");
+  card(true);
+  res = USER_Driver.disk_ioctl(0, GET_SECTOR_COUNT, &n);
+  check(res == RES_OK && n == SECTORS, "GET_SECTOR_COUNT = %lu",
+        (unsigned long)n);
+  res = USER_Driver.disk_ioctl(0, GET_SECTOR_SIZE, &ss);
+  check(res == RES_OK && ss == 512, "GET_SECTOR_SIZE = %u", ss);
+  res = USER_Driver.disk_ioctl(0, GET_BLOCK_SIZE, &n);
+  check(res == RES_OK && n == 8192, "GET_BLOCK_SIZE = %lu (AU 4 MiB)",
+        (unsigned long)n);
+  check(USER_Driver.disk_ioctl(0, MMC_GET_CSD, reg) == RES_OK &&
+            reg[0] == 0x40 && reg[15] == (uint8_t)(sd_emu_crc7(reg, 15) << 1 | 1),
+        "MMC_GET_CSD: v2, CRC7 ok");
+  check(USER_Driver.disk_ioctl(0, MMC_GET_CID, reg) == RES_OK &&
+            memcmp(&reg[3], "EMU01", 5) == 0,
+        "MMC_GET_CID: product name");
+
+  // 캐시에 들어간 섹터를 지우면 이후 읽기는 지워진 값을 봐야 한다
+  USER_Driver.disk_read(0, r, 700, 1);
+  range[0] = 600;
+  range[1] = 799;
+  check(USER_Driver.disk_ioctl(0, CTRL_TRIM, range) == RES_OK &&
+            sd_emu_stats.cmds[38] == 1,
+        "CTRL_TRIM 600..799: CMD32/33/38");
+  check(memcmp(image(600), zero, 512) == 0 && memcmp(image(799), zero, 512) == 0 &&
+            memcmp(image(800), zero, 512) != 0 && memcmp(image(599), zero, 512) != 0,
+        "only the range is erased");
+  USER_Driver.disk_read(0, r, 700, 1);
+  check(memcmp(r, zero, 512) == 0, "cached sector reads back erased");
+  check(USER_Driver.disk_ioctl(0, 99, NULL) == RES_PARERR,
+        "unknown command -> RES_PARERR");
+  clean();
+}
+
+/*                                  SYNC                                     */
+
+static void test_sync(void) {
+  uint8_t w[512], before[512];
+
+  printf("sync:\n");
+  card(true);
+  pattern(w, 1, 42);
+  memcpy(before, image(321), 512);
+  USER_Driver.disk_write(0, w, 321, 1);
+  check(memcmp(image(321), before, 512) == 0,
+        "1-sector write stays in the write-back cache");
+  check(USER_Driver.disk_ioctl(0, CTRL_SYNC, NULL) == RES_OK &&
+            memcmp(image(321), w, 512) == 0,
+        "CTRL_SYNC writes it to the card");
+  clean();
+}
+
+/*                                  캐시                                     */
+
+static SD_Cache_Stats cache_stats(void) {
+  SD_Cache_Stats st;
+
+  SD_Cache_GetStats(&st);
+  return st;
+}
+
+// 1섹터 읽기/쓰기는 LRU 캐시(SD_CACHE_ENTRIES개)를 거친다. 연속 섹터를
+// 1섹터씩 읽으면 read-ahead가 가져가므로 여기서는 떨어진 섹터만 쓴다
+static void test_cache(void) {
+  static uint8_t w[8 * 512], r[8 * 512];
+  static const DWORD meta[] = {100, 200, 300, 400};
+  SD_Cache_Stats st;
+  uint32_t cmd17;
+  bool ok = true;
+
+  printf("write-back cache (%d entries):\n", SD_CACHE_ENTRIES);
+  card(true);
+  SD_Cache_ResetStats();
+  for (int i = 0; i < 4; i++) USER_Driver.disk_read(0, r, meta[i], 1);
+  cmd17 = sd_emu_stats.cmds[17];
+  for (int i = 0; i < 4; i++) {
+    USER_Driver.disk_read(0, r, meta[i], 1);
+    ok &= memcmp(r, image(meta[i]), 512) == 0;
+  }
+  st = cache_stats();
+  check(ok && st.misses == 4 && st.hits == 4 && sd_emu_stats.cmds[17] == cmd17,
+        "4 sectors read twice: 4 misses, 4 hits, no card reads for the hits");
+
+  // 100을 다시 쓰였으므로 가장 오래된 것은 200
+  USER_Driver.disk_read(0, r, 100, 1);
+  USER_Driver.disk_read(0, r, 500, 1);
+  st = cache_stats();
+  cmd17 = sd_emu_stats.cmds[17];
+  USER_Driver.disk_read(0, r, 100, 1);
+  ok = sd_emu_stats.cmds[17] == cmd17;
+  USER_Driver.disk_read(0, r, 200, 1);
+  check(ok && st.evictions == 1 && sd_emu_stats.cmds[17] == cmd17 + 1,
+        "5th sector evicts the least recently used one");
+
+  // dirty 섹터는 Sync에서 섹터 순으로 묶어 한 번에 쓴다
+  card(true);
+  SD_Cache_ResetStats();
+  sd_emu_reset_stats();
+  pattern(w, 4, 5);
+  USER_Driver.disk_write(0, w + 2 * 512, 1002, 1);
+  USER_Driver.disk_write(0, w, 1000, 1);
+  USER_Driver.disk_write(0, w + 3 * 512, 1010, 1);
+  USER_Driver.disk_write(0, w + 1 * 512, 1001, 1);
+  check(sd_emu_stats.blocks_written == 0, "4 single-sector writes stay cached");
+  USER_Driver.disk_read(0, r, 999, 4);
+  check(memcmp(r + 512, w, 3 * 512) == 0 && memcmp(r, image(999), 512) == 0,
+        "multi-sector read sees the dirty sectors");
+  check(USER_Driver.disk_ioctl(0, CTRL_SYNC, NULL) == RES_OK &&
+            memcmp(image(1000), w, 3 * 512) == 0 &&
+            memcmp(image(1010), w + 3 * 512, 512) == 0,
+        "CTRL_SYNC writes them");
+  st = cache_stats();
+  check(st.flushes == 2 && st.flushed_sectors == 4 &&
+            sd_emu_stats.cmds[25] == 1 && sd_emu_stats.cmds[24] == 1,
+        "1000..1002 as one CMD25, 1010 as CMD24");
+  sd_emu_reset_stats();
+  check(USER_Driver.disk_ioctl(0, CTRL_SYNC, NULL) == RES_OK &&
+            sd_emu_stats.blocks_written == 0,
+        "second CTRL_SYNC has nothing to write");
+
+  // 여러 섹터 쓰기는 곧바로 카드로 가고, 캐시의 사본도 맞춘다
+  pattern(w, 4, 6);
+  USER_Driver.disk_write(0, w, 1000, 4);
+  cmd17 = sd_emu_stats.cmds[17];
+  USER_Driver.disk_read(0, r, 1001, 1);
+  check(memcmp(image(1000), w, 4 * 512) == 0 && memcmp(r, w + 512, 512) == 0 &&
+            sd_emu_stats.cmds[17] == cmd17,
+        "multi-sector write goes through and updates the cached copy");
+
+  // dirty 엔트리가 밀려나면 다른 dirty 섹터와 함께 쓴다
+  pattern(w, 4, 7);
+  for (int i = 0; i < 4; i++) USER_Driver.disk_write(0, w + i * 512, 3000 + i, 1);
+  sd_emu_reset_stats();
+  SD_Cache_ResetStats();
+  USER_Driver.disk_read(0, r, 4000, 1);
+  st = cache_stats();
+  check(st.evictions == 1 && st.flushes == 1 && sd_emu_stats.cmds[25] == 1 &&
+            memcmp(image(3000), w, 4 * 512) == 0,
+        "evicting a dirty entry flushes all 4 as one CMD25");
+
+  // 쓰기 오류: Sync는 실패를 알리고 섹터는 dirty로 남는다
+  pattern(w, 1, 8);
+  USER_Driver.disk_write(0, w, 3100, 1);
+  sd_emu_faults.write_error = 1;
+  check(USER_Driver.disk_ioctl(0, CTRL_SYNC, NULL) == RES_ERROR,
+        "CTRL_SYNC after a write error -> RES_ERROR");
+  check(USER_Driver.disk_ioctl(0, CTRL_SYNC, NULL) == RES_OK &&
+            memcmp(image(3100), w, 512) == 0,
+        "the sector stays dirty and the next CTRL_SYNC writes it");
+  clean();
+}
+
+/*                                read-ahead                                 */
+
+static SD_Prefetch_Stats prefetch_stats(void) {
+  SD_Prefetch_Stats st;
+
+  SD_Prefetch_GetStats(&st);
+  return st;
+}
+
+// 1섹터씩 차례로 읽으면 두 번째부터 SD_PREFETCH_DEPTH개씩 CMD18로 미리
+// 읽는다. 첫 섹터는 아직 연속인지 모르므로 캐시로 간다
+static void test_prefetch(void) {
+  static uint8_t w[4 * 512], r[512];
+  SD_Prefetch_Stats st;
+  bool ok = true;
+
+  printf("read-ahead (depth %d):\n", SD_PREFETCH_DEPTH);
+  card(true);
+  SD_Prefetch_SetMetaWindow(2000, 100);
+  SD_Prefetch_ResetStats();
+  sd_emu_reset_stats();
+  for (DWORD s = 6000; s < 6064; s++) {
+    ok &= USER_Driver.disk_read(0, r, s, 1) == RES_OK &&
+          memcmp(r, image(s), 512) == 0;
+  }
+  st = prefetch_stats();
+  check(ok, "64 sequential 1-sector reads return the card data");
+  check(st.misses == 1 && st.hits == 62 && st.wasted == 0 &&
+            sd_emu_stats.cmds[17] == 1 &&
+            sd_emu_stats.cmds[18] == 1 + 63 / SD_PREFETCH_DEPTH,
+        "1 miss, %u hits, 1 CMD17 + %u CMD18", (unsigned)st.hits,
+        (unsigned)sd_emu_stats.cmds[18]);
+
+  // FAT 조회(보호 구간)는 스트림을 끊지 않고, 다른 곳을 읽으면 버린다
+  SD_Prefetch_ResetStats();
+  USER_Driver.disk_read(0, r, 2050, 1);
+  ok = USER_Driver.disk_read(0, r, 6064, 1) == RES_OK &&
+       memcmp(r, image(6064), 512) == 0;
+  st = prefetch_stats();
+  check(ok && st.hits == 1 && st.wasted == 0,
+        "FAT read inside the meta window keeps the stream");
+  USER_Driver.disk_read(0, r, 9000, 1);
+  st = prefetch_stats();
+  check(st.wasted == SD_PREFETCH_DEPTH,
+        "read outside the window drops the ring (%u wasted)",
+        (unsigned)st.wasted);
+  ok = USER_Driver.disk_read(0, r, 6065, 1) == RES_OK &&
+       memcmp(r, image(6065), 512) == 0;
+  USER_Driver.disk_read(0, r, 6066, 1);
+  st = prefetch_stats();
+  check(ok && st.misses == 1 && st.hits == 1,
+        "going back to the file re-detects the stream");
+  clean();
+
+  // 미리 읽은 섹터에 쓰면 버리고 새 내용을 읽는다
+  pattern(w, 4, 9);
+  USER_Driver.disk_write(0, w, 6067, 2);
+  ok = USER_Driver.disk_read(0, r, 6067, 1) == RES_OK &&
+       memcmp(r, w, 512) == 0;
+  ok &= USER_Driver.disk_read(0, r, 6068, 1) == RES_OK &&
+        memcmp(r, w + 512, 512) == 0;
+  check(ok, "multi-sector write into the ring -> new data");
+
+  // dirty 섹터가 캐시에 있는 동안 read-ahead가 옛 내용을 읽어 올 수 있다.
+  // Sync 뒤 캐시에서 밀려나도 그 옛 내용이 보이면 안 된다
+  card(true);
+  SD_Prefetch_SetMetaWindow(2000, 100);
+  USER_Driver.disk_read(0, r, 7000, 1);
+  USER_Driver.disk_read(0, r, 7001, 1);
+  USER_Driver.disk_write(0, w + 2 * 512, 7003, 1);
+  USER_Driver.disk_read(0, r, 7002, 1);
+  ok = USER_Driver.disk_read(0, r, 7003, 1) == RES_OK &&
+       memcmp(r, w + 2 * 512, 512) == 0;
+  USER_Driver.disk_ioctl(0, CTRL_SYNC, NULL);
+  for (DWORD s = 2001; s <= 2004; s++) USER_Driver.disk_read(0, r, s, 1);
+  ok &= USER_Driver.disk_read(0, r, 7003, 1) == RES_OK &&
+        memcmp(r, w + 2 * 512, 512) == 0;
+  check(ok, "sector written while streaming reads back new after Sync");
+  clean();
+}
+
+/*                                  벤치                                     */
+
+#if SD_USE_DMA
+#define XFER "DMA"
+#elif SD_BLOCK_BYTE_LOOP
+#define XFER "byte loop"
+#else
+#define XFER "block"
+#endif
+
+// 데이터 블록 전송 방식의 비용: 섹터당 HAL 호출, CPU가 묶인 시간, DMA가 대신
+// 옮긴 시간. 1 MiB를 128섹터씩 CMD18/CMD25로 옮긴다
+static void bench_xfer(void) {
+  static uint8_t buf[128 * 512];
+  const UINT total = 2048;
+
+  printf("%-9s  HAL calls/sector  CPU us/sector  cycles/sector  "
+         "DMA us/sector      KB/s\n", XFER);
+  pattern(buf, 128, 2);
+  for (int write = 0; write < 2; write++) {
+    double t, cpu;
+
+    mark();
+    for (UINT s = 0; s < total; s += 128) {
+      if (write) {
+        SD_Write(0, buf, 3000 + s, 128);
+      } else {
+        SD_Read(0, buf, 3000 + s, 128);
+      }
+    }
+    t = since_s();
+    cpu = (double)(host_stats.cpu_ns - mark_stats.cpu_ns) / total;
+    printf("  %-5s    %10.1f       %10.1f     %10.0f     %10.1f %9.0f\n",
+           write ? "write" : "read",
+           (double)(host_stats.calls - mark_stats.calls) / total, cpu / 1e3,
+           cpu * (HOST_SYSCLK_HZ / 1e9),
+           (double)(host_stats.dma_ns - mark_stats.dma_ns) / total / 1e3,
+           total * 512 / t / 1e3);
+  }
+}
+
+// 1 MiB를 n섹터씩 SD_Write로 쓴다(로깅처럼 연속 섹터)
+static void bench_write(void) {
+  static const UINT bursts[] = {1, 8, 64, 128};
+  static uint8_t w[128 * 512];
+  const UINT total = 2048;
+
+  printf("write burst   sectors/s      KB/s\n");
+  pattern(w, 128, 1);
+  for (size_t i = 0; i < sizeof(bursts) / sizeof(bursts[0]); i++) {
+    UINT n = bursts[i];
+    double t;
+
+    mark();
+    for (UINT s = 0; s < total; s += n) SD_Write(0, w, 3000 + s, n);
+    t = since_s();
+    printf("  %4u       %9.0f %9.0f\n", n, total / t, total * 512 / t / 1e3);
+  }
+}
+
+// CRC 모드의 비용. CRC 바이트는 꺼져 있어도 클럭하므로 버스 시간은 같고,
+// 테이블 CRC16의 CPU 시간은 HAL 스텁이 재지 않는다. 그래서 여기서 보이는
+// 차이는 CRC가 틀린 블록을 다시 요청하는 비용이다(128블록마다 하나씩 틀림)
+static void bench_crc(void) {
+  static const char* const rows[] = {"off", "on", "on, 1 bad/128"};
+  static uint8_t buf[128 * 512];
+  const UINT total = 2048;
+
+  printf("CRC              read KB/s  write KB/s\n");
+  pattern(buf, 128, 3);
+  for (int row = 0; row < 3; row++) {
+    double rd, wr;
+
+    SD_SetCRC(row > 0);
+    mark();
+    for (UINT s = 0; s < total; s += 128) {
+      sd_emu_faults.read_crc = row == 2;
+      SD_Read(0, buf, 3000 + s, 128);
+    }
+    rd = total * 512 / since_s();
+    mark();
+    for (UINT s = 0; s < total; s += 128) {
+      sd_emu_faults.write_crc = row == 2;
+      SD_Write(0, buf, 3000 + s, 128);
+    }
+    wr = total * 512 / since_s();
+    printf("  %-13s  %9.0f   %9.0f\n", rows[row], rd / 1e3, wr / 1e3);
+  }
+  SD_SetCRC(false);
+}
+
+// FatFs가 f_puts로 한 줄씩 덧붙이고 주기적으로 f_sync할 때 diskio에 내려오는
+// 요청을 흉내낸다(4 KiB 클러스터). 채운 데이터 섹터는 1섹터 쓰기이고,
+// f_sync는 덜 채운 섹터, 바뀐 FAT 섹터, 파일 크기를 고친 디렉터리 섹터를 쓴
+// 뒤 CTRL_SYNC를 보낸다. 캐시 없이 카드로 바로 보낸 경우와 비교한다
+static void log_io(bool cached, bool write, uint8_t* buf, DWORD sector) {
+  if (cached) {
+    if (write) {
+      USER_Driver.disk_write(0, buf, sector, 1);
+    } else {
+      USER_Driver.disk_read(0, buf, sector, 1);
+    }
+  } else {
+    if (write) {
+      SD_Write(0, buf, sector, 1);
+    } else {
+      SD_Read(0, buf, sector, 1);
+    }
+  }
+}
+
+static void bench_log(void) {
+  enum { LINE = 48, LINES = 2048, CLUSTER = 8 * 512 };
+  static const int every[] = {1, 8, 64};
+  const DWORD fat = 2000, dir = 4000, data = 8192;
+  static uint8_t sec[512], win[512];
+
+  printf("append log, %d x %d B lines:\n%33s  card writes  blocks  "
+         "hits/misses/flushes\n", LINES, LINE, "ms");
+  for (size_t e = 0; e < sizeof(every) / sizeof(every[0]); e++) {
+    for (int cached = 0; cached < 2; cached++) {
+      uint32_t size = 0;
+      bool fat_dirty = false;
+      SD_Cache_Stats st;
+      double t;
+
+      card(true);
+      SD_Cache_ResetStats();
+      sd_emu_reset_stats();
+      mark();
+      for (int i = 1; i <= LINES; i++) {
+        for (int k = 0; k < LINE; k++) {
+          if (size % CLUSTER == 0) {  // 클러스터 할당: FAT 섹터로 창 이동
+            log_io(cached, false, win, fat + size / CLUSTER / 128);
+            fat_dirty = true;
+          }
+          sec[size++ % 512] = (uint8_t)(i + k);
+          if (size % 512 == 0) log_io(cached, true, sec, data + size / 512 - 1);
+        }
+        if (i % every[e]) continue;
+        if (size % 512) log_io(cached, true, sec, data + size / 512);
+        if (fat_dirty) log_io(cached, true, win, fat + (size - 1) / CLUSTER / 128);
+        fat_dirty = false;
+        log_io(cached, false, win, dir);
+        log_io(cached, true, win, dir);
+        if (cached) {
+          USER_Driver.disk_ioctl(0, CTRL_SYNC, NULL);
+        } else {
+          SD_ioctl(0, CTRL_SYNC, NULL);
+        }
+      }
+      t = since_s();
+      SD_Cache_GetStats(&st);
+      printf("  f_sync every %-2d, %-6s %7.1f  %9u  %6u  ", every[e],
+             cached ? "cache" : "direct", t * 1e3,
+             (unsigned)(sd_emu_stats.cmds[24] + sd_emu_stats.cmds[25]),
+             (unsigned)sd_emu_stats.blocks_written);
+      if (cached) {
+        printf("%u/%u/%u\n", (unsigned)st.hits, (unsigned)st.misses,
+               (unsigned)st.flushes);
+      } else {
+        printf("-\n");
+      }
+    }
+  }
+}
+
+// MP3_Feeder처럼 f_read로 32바이트씩 소비하는 재생(128 kbps, 32바이트에 2 ms).
+// 그 사이 슈퍼루프는 SD_PollAsync를 부른다. 클러스터(8섹터)마다 FAT을 읽는다.
+// 섹터 하나를 얻는 데 걸린 시간의 평균과 최대를 read-ahead 유무로 비교한다.
+// 최대는 스트림을 감지하는 첫 클러스터를 뺀 값이다
+static void bench_stream(void) {
+  static uint8_t buf[512];
+  const UINT total = 1024;
+
+  printf("stream, 1-sector reads      avg us   max us  hit rate\n");
+  for (int ahead = 0; ahead < 2; ahead++) {
+    uint64_t sum = 0, worst = 0;
+    SD_Prefetch_Stats st;
+
+    card(true);
+    SD_Prefetch_SetMetaWindow(2000, 100);
+    SD_Prefetch_ResetStats();
+    for (UINT i = 0; i < total; i++) {
+      uint64_t t0 = host_now_ns(), dt;
+
+      if (ahead) {
+        if (i % 8 == 0) USER_Driver.disk_read(0, buf, 2000 + i / 8 / 128, 1);
+        USER_Driver.disk_read(0, buf, 8000 + i, 1);
+      } else {
+        if (i % 8 == 0) SD_Read(0, buf, 2000 + i / 8 / 128, 1);
+        SD_Read(0, buf, 8000 + i, 1);
+      }
+      dt = host_now_ns() - t0;
+      sum += dt;
+      if (i >= 8 && dt > worst) worst = dt;
+      for (int k = 0; k < 512 / 32; k++) {
+        host_advance_ns(2000000);
+        SD_PollAsync();
+      }
+    }
+    SD_Prefetch_GetStats(&st);
+    printf("  %-24s %8.1f %8.1f  ", ahead ? "read-ahead" : "direct (CMD17)",
+           sum / 1e3 / total, worst / 1e3);
+    if (ahead) {
+      printf("%5.1f%%\n", 100.0 * st.hits / (st.hits + st.misses));
+    } else {
+      printf("    -\n");
+    }
+  }
+}
+
+static int bench(void) {
+  card(true);
+  printf("SPI %.2f MHz, card model: CMD24 busy %.2f ms, CMD25 %.2f ms/block "
+         "(%.2f pre-erased), Stop Tran %.2f ms\n",
+         host_spi_hz() / 1e6, sd_emu_timing.write_single_ns / 1e6,
+         sd_emu_timing.write_multi_ns / 1e6, sd_emu_timing.write_erased_ns / 1e6,
+         sd_emu_timing.stop_ns / 1e6);
+  bench_xfer();
+  bench_write();
+  bench_crc();
+  bench_log();
+  bench_stream();
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  printf("%s: SD_USE_SPI_BUS %d, data blocks by %s\n", APP, SD_USE_SPI_BUS,
+         XFER);
+  if (argc == 2 && strcmp(argv[1], "bench") == 0) return bench();
+  test_init();
+  roundtrip(true);
+  roundtrip(false);
+  test_multi_read();
+  test_multi_write();
+  test_crc();
+  test_ioctl();
+  test_sync();
+  test_cache();
+  test_prefetch();
+  if (failures) {
+    printf("sd_test: %d check(s) FAILED\n", failures);
+    return 1;
+  }
+  printf("sd_test: all checks passed\n");
+  return 0;
+}
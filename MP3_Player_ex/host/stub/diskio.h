@@ -0,0 +1,37 @@
+/**
+ * FatFs R0.12c diskio.h에서 diskio 계층이 쓰는 부분만(ff.c는 트리에 없음)
+ */
+#ifndef _DISKIO_DEFINED
+#define _DISKIO_DEFINED
+
+#include "integer.h"
+
+#define _USE_WRITE 1 /* 1: Enable disk_write function */
+#define _USE_IOCTL 1 /* 1: Enable disk_ioctl fucntion */
+
+typedef BYTE DSTATUS;
+
+typedef enum {
+    RES_OK = 0, /* 0: Successful */
+    RES_ERROR,  /* 1: R/W Error */
+    RES_WRPRT,  /* 2: Write Protected */
+    RES_NOTRDY, /* 3: Not Ready */
+    RES_PARERR  /* 4: Invalid Parameter */
+} DRESULT;
+
+#define STA_NOINIT 0x01
+#define STA_NODISK 0x02
+#define STA_PROTECT 0x04
+
+#define CTRL_SYNC 0
+#define GET_SECTOR_COUNT 1
+#define GET_SECTOR_SIZE 2
+#define GET_BLOCK_SIZE 3
+#define CTRL_TRIM 4
+#define MMC_GET_TYPE 10
+#define MMC_GET_CSD 11
+#define MMC_GET_CID 12
+#define MMC_GET_OCR 13
+#define MMC_GET_SDSTAT 14
+
+#endif
@@ -0,0 +1,10 @@
+/**
+ * FatFs ff.h 대신. 트리의 ffconf.h(→ main.h)를 읽는 것까지만 같다.
+ */
+#ifndef _FATFS
+#define _FATFS 68300
+
+#include "integer.h"
+#include "ffconf.h"
+
+#endif
@@ -0,0 +1,22 @@
+/**
+ * ST ff_gen_drv.h의 드라이버 테이블 타입
+ */
+#ifndef __FF_GEN_DRV_H
+#define __FF_GEN_DRV_H
+
+#include "diskio.h"
+#include "ff.h"
+
+typedef struct {
+    DSTATUS (*disk_initialize)(BYTE);
+    DSTATUS (*disk_status)(BYTE);
+    DRESULT (*disk_read)(BYTE, BYTE *, DWORD, UINT);
+#if _USE_WRITE == 1
+    DRESULT (*disk_write)(BYTE, const BYTE *, DWORD, UINT);
+#endif
+#if _USE_IOCTL == 1
+    DRESULT (*disk_ioctl)(BYTE, BYTE, void *);
+#endif
+} Diskio_drvTypeDef;
+
+#endif
@@ -0,0 +1,17 @@
+/**
+ * FatFs(Middlewares/Third_Party/FatFs)는 이 트리에 없다. diskio 계층이 쓰는
+ * 정수 타입만 FatFs R0.12c와 같게 둔다.
+ */
+#ifndef _FF_INTEGER
+#define _FF_INTEGER
+
+typedef int            INT;
+typedef unsigned int   UINT;
+typedef unsigned char  BYTE;
+typedef short          SHORT;
+typedef unsigned short WORD;
+typedef unsigned short WCHAR;
+typedef long           LONG;
+typedef unsigned long  DWORD;
+
+#endif
@@ -0,0 +1,161 @@
+/**
+ * PC 빌드용 STM32F1 HAL 스텁. fatfs_sd.c, spi_bus.c, sd_cache.c,
+ * sd_prefetch.c, user_diskio.c가 쓰는 이름만 선언한다. 동작은 hal_stub.c에
+ * 있고, SPI1의 바이트는 sd_emu.c의 카드 모델로 간다.
+ */
+#ifndef __STM32F1xx_HAL_H
+#define __STM32F1xx_HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UNUSED(X) (void)X
+#define SET_BIT(REG, BIT) ((REG) |= (BIT))
+#define CLEAR_BIT(REG, BIT) ((REG) &= ~(BIT))
+#define READ_BIT(REG, BIT) ((REG) & (BIT))
+#define MODIFY_REG(REG, CLEARMASK, SETMASK)                                    \
+    ((REG) = (((REG) & (~(CLEARMASK))) | (SETMASK)))
+
+typedef enum {
+    HAL_OK      = 0x00U,
+    HAL_ERROR   = 0x01U,
+    HAL_BUSY    = 0x02U,
+    HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+/*                                   GPIO                                     */
+
+typedef struct {
+    volatile uint32_t ODR;
+} GPIO_TypeDef;
+
+typedef enum { GPIO_PIN_RESET = 0U, GPIO_PIN_SET } GPIO_PinState;
+
+extern GPIO_TypeDef host_gpio[5];
+#define GPIOA (&host_gpio[0])
+#define GPIOB (&host_gpio[1])
+#define GPIOC (&host_gpio[2])
+#define GPIOD (&host_gpio[3])
+#define GPIOE (&host_gpio[4])
+
+#define GPIO_PIN_0 ((uint16_t)0x0001)
+#define GPIO_PIN_1 ((uint16_t)0x0002)
+#define GPIO_PIN_2 ((uint16_t)0x0004)
+#define GPIO_PIN_3 ((uint16_t)0x0008)
+#define GPIO_PIN_4 ((uint16_t)0x0010)
+#define GPIO_PIN_12 ((uint16_t)0x1000)
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin,
+                       GPIO_PinState PinState);
+
+/*                                   SPI                                      */
+
+typedef struct {
+    volatile uint32_t CR1;
+    volatile uint32_t CR2;
+    volatile uint32_t SR;
+    volatile uint32_t DR;
+    volatile uint32_t CRCPR;
+    volatile uint32_t RXCRCR;
+    volatile uint32_t TXCRCR;
+} SPI_TypeDef;
+
+extern SPI_TypeDef host_spi[2];
+#define SPI1 (&host_spi[0])
+#define SPI2 (&host_spi[1])
+
+#define SPI_CR1_CPHA 0x0001U
+#define SPI_CR1_CPOL 0x0002U
+#define SPI_CR1_BR 0x0038U
+#define SPI_CR1_SPE 0x0040U
+
+#define SPI_BAUDRATEPRESCALER_2 0x00000000U
+#define SPI_BAUDRATEPRESCALER_4 0x00000008U
+#define SPI_BAUDRATEPRESCALER_8 0x00000010U
+#define SPI_BAUDRATEPRESCALER_16 0x00000018U
+#define SPI_BAUDRATEPRESCALER_32 0x00000020U
+#define SPI_BAUDRATEPRESCALER_64 0x00000028U
+#define SPI_BAUDRATEPRESCALER_128 0x00000030U
+#define SPI_BAUDRATEPRESCALER_256 0x00000038U
+#define SPI_POLARITY_LOW 0x00000000U
+#define SPI_POLARITY_HIGH SPI_CR1_CPOL
+#define SPI_PHASE_1EDGE 0x00000000U
+#define SPI_PHASE_2EDGE SPI_CR1_CPHA
+
+typedef struct {
+    uint32_t BaudRatePrescaler;
+    uint32_t CLKPolarity;
+    uint32_t CLKPhase;
+} SPI_InitTypeDef;
+
+typedef enum {
+    HAL_SPI_STATE_RESET = 0x00U,
+    HAL_SPI_STATE_READY = 0x01U,
+    HAL_SPI_STATE_BUSY  = 0x02U
+} HAL_SPI_StateTypeDef;
+
+typedef struct __SPI_HandleTypeDef {
+    SPI_TypeDef         *Instance;
+    SPI_InitTypeDef      Init;
+    HAL_SPI_StateTypeDef State;
+} SPI_HandleTypeDef;
+
+#define __HAL_SPI_ENABLE(h) SET_BIT((h)->Instance->CR1, SPI_CR1_SPE)
+#define __HAL_SPI_DISABLE(h) CLEAR_BIT((h)->Instance->CR1, SPI_CR1_SPE)
+
+HAL_StatusTypeDef    HAL_SPI_Init(SPI_HandleTypeDef *hspi);
+HAL_SPI_StateTypeDef HAL_SPI_GetState(SPI_HandleTypeDef *hspi);
+HAL_StatusTypeDef    HAL_SPI_Transmit(SPI_HandleTypeDef *hspi,
+                                      const uint8_t *pData, uint16_t Size,
+                                      uint32_t Timeout);
+HAL_StatusTypeDef    HAL_SPI_TransmitReceive(SPI_HandleTypeDef *hspi,
+                                             const uint8_t *pTxData,
+                                             uint8_t *pRxData, uint16_t Size,
+                                             uint32_t Timeout);
+HAL_StatusTypeDef    HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi,
+                                          const uint8_t *pData, uint16_t Size);
+HAL_StatusTypeDef    HAL_SPI_TransmitReceive_DMA(SPI_HandleTypeDef *hspi,
+                                                 const uint8_t *pTxData,
+                                                 uint8_t *pRxData,
+                                                 uint16_t Size);
+HAL_StatusTypeDef    HAL_SPI_Abort(SPI_HandleTypeDef *hspi);
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi);
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef *hspi);
+
+/*                                   UART                                     */
+
+/* MicroSD_FATFS_ex의 user_diskio.c가 extern으로만 선언한다 */
+typedef struct {
+    void *Instance;
+} UART_HandleTypeDef;
+
+/*                              RCC / tick / core                             */
+
+extern uint32_t SystemCoreClock;
+uint32_t        HAL_RCC_GetPCLK2Freq(void);
+uint32_t        HAL_GetTick(void);
+void            HAL_Delay(uint32_t Delay);
+
+typedef struct {
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+    volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+extern DWT_Type       host_dwt;
+extern CoreDebug_Type host_core_debug;
+#define DWT (&host_dwt)
+#define CoreDebug (&host_core_debug)
+#define DWT_CTRL_CYCCNTENA_Msk 1U
+#define CoreDebug_DEMCR_TRCENA_Msk (1U << 24)
+
+extern uint32_t host_primask;
+static inline uint32_t __get_PRIMASK(void) { return host_primask; }
+static inline void __set_PRIMASK(uint32_t m) { host_primask = m; }
+static inline void __disable_irq(void) { host_primask = 1; }
+static inline void __enable_irq(void) { host_primask = 0; }
+
+#endif
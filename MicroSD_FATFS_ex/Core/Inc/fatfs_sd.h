@@ -15,17 +15,24 @@ extern SPI_HandleTypeDef hspi1;
 typedef enum {
     SD_CMD0   = (0x40 + 0),
     SD_CMD1   = (0x40 + 1),
+    SD_ACMD13 = (0x40 + 13),
+    SD_ACMD23 = (0x40 + 23),
     SD_ACMD41 = (0x40 + 41),
     SD_CMD8   = (0x40 + 8),
     SD_CMD9   = (0x40 + 9),
+    SD_CMD10  = (0x40 + 10),
     SD_CMD12  = (0x40 + 12),
     SD_CMD16  = (0x40 + 16),
     SD_CMD17  = (0x40 + 17),
     SD_CMD18  = (0x40 + 18),
     SD_CMD24  = (0x40 + 24),
     SD_CMD25  = (0x40 + 25),
+    SD_CMD32  = (0x40 + 32),
+    SD_CMD33  = (0x40 + 33),
+    SD_CMD38  = (0x40 + 38),
     SD_CMD55  = (0x40 + 55),
     SD_CMD58  = (0x40 + 58),
+    SD_CMD59  = (0x40 + 59),
 } SD_Command_Type;
 
 typedef enum {
@@ -46,6 +53,11 @@ typedef enum {
 } SD_Response_Error_Type;
 
 #define SD_SPI_TIMEOUT_MS 500
+#define SD_ERASE_TIMEOUT_MS 30000
+/**
+ * STM32F103 SPI 최대 클럭 (datasheet: fPCLK/2, 최대 18 MHz)
+ */
+#define SD_SPI_MAX_HZ 18000000
 
 typedef uint8_t SD_Response;
 typedef uint8_t SD_Information[4];
@@ -60,6 +72,11 @@ typedef enum {
 
 DSTATUS SD_Initialize(BYTE pdrv);
 
+/**
+ * 초기화 후 협상된 SPI 클럭(Hz)
+ */
+uint32_t SD_GetClock();
+
 DSTATUS SD_Status(BYTE pdrv);
 
 DSTATUS SD_ioctl(BYTE pdrv, BYTE cmd, void *buff);
@@ -74,9 +91,40 @@ DSTATUS SD_Write(BYTE pdrv, /* Physical drive nmuber to identify the drive */
                  DWORD       sector, /* Sector address in LBA */
                  UINT        count);
 
+DSTATUS SD_WriteBlocks(BYTE pdrv, const BYTE *const *blocks, DWORD sector,
+                       UINT count);
+
 SD_Version_Type SD_GetVersion();
 
-#define SD_GET_CSD_STRUCTURE_VERSION(csd) ((csd & 0xC0000000) >> 7)
+/*                         Asynchronous Read/Write                            */
+
+typedef enum {
+    SD_REQUEST_IDLE,
+    SD_REQUEST_BUSY,
+    SD_REQUEST_DONE,
+    SD_REQUEST_ERROR
+} SD_Request_Status;
+
+typedef void (*SD_Request_Callback)(DRESULT result);
+
+/**
+ * 요청은 한 번에 하나만 처리한다. 진행 중인 요청이 있으면 false를 반환한다.
+ * callback은 SD_PollAsync 안에서 요청이 끝났을 때 호출된다(NULL 가능).
+ */
+bool SD_ReadAsync(BYTE *buff, DWORD sector, UINT count,
+                  SD_Request_Callback callback);
+bool SD_WriteAsync(const BYTE *buff, DWORD sector, UINT count,
+                   SD_Request_Callback callback);
+SD_Request_Status SD_PollAsync();
+bool              SD_IsAsyncBusy();
+
+/**
+ * CSD(16바이트)를 MSB부터 32비트 단위로 묶은 값. idx 0이 [127:96]비트.
+ */
+#define SD_CSD_WORD(csd, idx)                                                  \
+    (((DWORD)(csd)[(idx) * 4] << 24) | ((DWORD)(csd)[(idx) * 4 + 1] << 16) |   \
+     ((DWORD)(csd)[(idx) * 4 + 2] << 8) | (DWORD)(csd)[(idx) * 4 + 3])
+#define SD_GET_CSD_STRUCTURE_VERSION(csd) ((csd & 0xC0000000) >> 30)
 #define SD_CSD_VERSION_1 0
 #define SD_CSD_VERSION_2 1
 #define SD_GET_SECTOR_COUNT_ON_CSD_VERSION_2(csd96_64, csd63_32)               \
@@ -92,9 +140,75 @@ typedef uint8_t  SD_DataCRC;
 #define SD_STOP_DATA_TOKEN_CMD25 0xFD
 
 typedef uint8_t SD_DataResponse;
-#define SD_IS_DATA_ACCEPTED(data_res) (data_res & 0x05)
-#define SD_IS_DATA_REJECTED_WITH_CRC_ERROR(data_res) (data_res == 0x0B)
-#define SD_IS_DATA_REJECTED_WITH_WRITE_ERROR(data_res) (data_res == 0x0C)
+#define SD_IS_DATA_ACCEPTED(data_res) ((data_res & 0x1F) == 0x05)
+#define SD_IS_DATA_REJECTED_WITH_CRC_ERROR(data_res) ((data_res & 0x1F) == 0x0B)
+#define SD_IS_DATA_REJECTED_WITH_WRITE_ERROR(data_res)                         \
+    ((data_res & 0x1F) == 0x0D)
+
+/**
+ * 1: CMD25 전에 ACMD23으로 쓸 블록 수를 미리 알려서 카드가 미리 지우도록 함
+ */
+#define SD_USE_ACMD23_PRE_ERASE 1
+
+/**
+ * 1: 데이터 블록(512바이트)을 SPI1 DMA(hdma_spi1_rx/tx)로 한 번에 전송
+ * 0: HAL 블록 전송(폴링)으로 한 번에 전송
+ */
+#ifndef SD_USE_DMA
+#define SD_USE_DMA 0 /* 이 예제는 SPI1 DMA 채널을 설정하지 않았다 */
+#endif
+
+/**
+ * 1: SD_USE_DMA가 0일 때 데이터 블록도 바이트마다 HAL을 호출한다(블록 전송
+ *    이전의 방식). MP3_Player_ex/host의 벤치에서 블록/DMA 전송과 비교하는
+ *    용도이고, 보드에서는 켤 이유가 없다.
+ */
+#ifndef SD_BLOCK_BYTE_LOOP
+#define SD_BLOCK_BYTE_LOOP 0
+#endif
+
+/**
+ * 1: SPI1을 spi_bus로 다른 장치(VS1053)와 나눠 쓴다. 프로젝트의 main.h에서
+ *    정의한다. CS와 분주비는 버스가 관리하고, 비동기 요청은 블록 사이에서
+ *    더 급한 장치에게 버스를 양보한다.
+ */
+#ifndef SD_USE_SPI_BUS
+#define SD_USE_SPI_BUS 0
+#endif
+
+/**
+ * SPI1 DMA 전송 완료 시 HAL_SPI_TxCpltCallback/HAL_SPI_TxRxCpltCallback에서
+ * 호출해야 한다.
+ */
+void SD_SPI_DMA_CpltCallback(void);
+
+/**
+ * 1: CMD59로 CRC 검사를 켜고, 명령에는 CRC7을, 데이터 블록에는 CRC16을
+ *    계산해서 붙이거나 비교한다. CRC가 틀린 블록은 SD_CRC_RETRIES번까지 다시
+ *    읽거나 쓴다.
+ * 0: 검사하지 않는다(기본값). 블록마다 CRC16 계산(512바이트 테이블 조회)과
+ *    비교가 붙고, 배선이 짧은 보드에서는 오류가 거의 없으므로 필요할 때
+ *    켠다. 실행 중에도 SD_SetCRC로 켜고 끌 수 있다.
+ */
+#ifndef SD_USE_CRC
+#define SD_USE_CRC 0
+#endif
+#define SD_CRC_RETRIES 3
+
+typedef struct {
+    uint32_t blocks;  /* CRC를 검사한 블록 수 */
+    uint32_t errors;  /* CRC가 틀린 블록 수 */
+    uint32_t retries; /* 다시 요청한 횟수 */
+} SD_CRC_Stats;
+
+/**
+ * CRC 모드를 켜고 끈다(카드에 CMD59 전송). 같은 파일을 두 모드로 읽어 보면
+ * CRC 계산에 드는 비용을 비교할 수 있다.
+ */
+bool SD_SetCRC(bool enable);
+bool SD_IsCRCEnabled();
+void SD_GetCRCStats(SD_CRC_Stats *out);
+void SD_ResetCRCStats();
 
 #define SD_OK true
 #define SD_ERROR false
@@ -1,5 +1,10 @@
 #include "fatfs_sd.h"
 
+#include <string.h>
+#if SD_USE_SPI_BUS
+#include "spi_bus.h"
+#endif
+
 static bool SD_PowerOn();
 static void SD_Select();
 static void SD_Deselect();
@@ -8,13 +13,144 @@ static SD_Response SD_Send_Command(SD_Command_Type cmd, DWORD arg);
 static void        SD_SPI_ReceiveInformation(SD_Information info);
 static void        SD_SPI_Send(BYTE data);
 static void        SD_SPI_SendReceive(BYTE request, BYTE *response);
+static bool        SD_SPI_StartBlock(const BYTE *tx, BYTE *rx, UINT len);
 
-static bool SD_BusyWait();
+static bool    SD_BusyWait();
+static bool    SD_BusyWaitFor(uint32_t timeout_ms);
+static bool    SD_ReadRegister(SD_Command_Type cmd, BYTE *buff, UINT len);
+static void    SD_NegotiateClock();
+static bool    SD_ProbeSector(DWORD sector, WORD *crc);
+static void    SD_SetPrescaler(uint8_t idx);
+static BYTE    SD_CRC7(BYTE cmd, DWORD arg);
+static WORD    SD_CRC16(const BYTE *buff, UINT len);
+static WORD    SD_BlockCRC(const BYTE *block);
+static bool    SD_RetryRequest();
+static DWORD   SD_SectorToAddress(DWORD sector);
+static void    SD_FinishAsync(DRESULT result);
+static DRESULT SD_WaitAsync();
+static bool    SD_StartWrite(const BYTE *buff, const BYTE *const *blocks,
+                             DWORD sector, UINT count,
+                             SD_Request_Callback callback);
 
 static DSTATUS           status;
 static SD_Version_Type   sd_version;
 extern volatile uint32_t Timer1, Timer2;
 
+#if SD_USE_SPI_BUS
+static void SD_BusPoll();
+static bool SD_BusResume();
+static void SD_BusYield();
+static void SD_BusYieldRead();
+
+/**
+ * 버스 위의 SD 카드. 가장 낮은 우선순위라서 오디오(SDI)나 SCI가 기다리면
+ * 블록 사이에서 비켜준다. 다른 장치가 버스를 기다리는 동안에는 SD_BusPoll로
+ * 진행 중인 요청을 양보 지점까지 밀어준다.
+ */
+static SPI_BusDevice sd_bus_dev = {
+    .csPort    = CS_GPIO_Port,
+    .csPin     = CS_Pin,
+    .prescaler = SPI_BAUDRATEPRESCALER_256,
+    .polarity  = SPI_POLARITY_LOW,
+    .phase     = SPI_PHASE_1EDGE,
+    .priority  = SPI_BUS_PRIO_BULK,
+    .poll      = SD_BusPoll,
+};
+#define SD_BUS (&spiBus1)
+#endif
+
+/**
+ * 분주비 후보. idx가 n이면 PCLK2 / 2^(n+1).
+ */
+static const uint32_t sd_prescalers[] = {
+    SPI_BAUDRATEPRESCALER_2,  SPI_BAUDRATEPRESCALER_4,
+    SPI_BAUDRATEPRESCALER_8,  SPI_BAUDRATEPRESCALER_16,
+    SPI_BAUDRATEPRESCALER_32, SPI_BAUDRATEPRESCALER_64,
+    SPI_BAUDRATEPRESCALER_128, SPI_BAUDRATEPRESCALER_256,
+};
+#define SD_PRESCALER_INIT 7
+static uint32_t sd_spi_hz;
+
+/**
+ * 읽기 시 MOSI를 high로 유지하기 위해 보내는 0xFF 블록
+ */
+static const BYTE sd_dummy_block[512] = {[0 ... 511] = 0xFF};
+static volatile bool sd_dma_busy;
+
+/**
+ * CRC 검사 상태. 카드 쪽 검사(CMD59)와 호스트 쪽 검사를 함께 켜고 끈다.
+ */
+static bool         sd_crc_on = SD_USE_CRC;
+static SD_CRC_Stats sd_crc_stats;
+
+/**
+ * CRC16-CCITT(x^16 + x^12 + x^5 + 1) 테이블. F1의 SPI CRC 유닛은 8비트
+ * 프레임(DFF=0)에서 CRC8만 계산하므로(RM0008 25.3.6) 데이터 블록의 CRC16은
+ * 이 테이블로 계산한다.
+ */
+static const WORD sd_crc16_table[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+    0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+    0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+    0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+    0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+    0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+    0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+    0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+    0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+    0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+    0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+    0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+    0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+    0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+    0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+    0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+    0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+    0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+    0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+    0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+    0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+    0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+    0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+    0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0,
+};
+
+/**
+ * 비동기 요청 상태
+ */
+typedef enum {
+    SD_ASYNC_IDLE,
+    SD_ASYNC_READ_WAIT_TOKEN,
+    SD_ASYNC_READ_DATA,
+    SD_ASYNC_READ_RESTART,
+    SD_ASYNC_WRITE_WAIT_READY,
+    SD_ASYNC_WRITE_DATA,
+    SD_ASYNC_WRITE_WAIT_BUSY,
+} SD_Async_State;
+
+static struct {
+    SD_Async_State      state;
+    SD_Request_Status   status;
+    DRESULT             result;
+    BYTE               *rbuff;
+    const BYTE         *wbuff;
+    const BYTE *const  *wblocks; /* NULL이 아니면 블록마다 다른 버퍼 사용 */
+    DWORD               sector;  /* 다음에 주고받을 섹터 */
+    UINT                count;
+    bool                multi;
+    bool                retry;   /* CRC 오류로 남은 블록을 다시 요청해야 함 */
+    uint8_t             retries;
+    SD_Request_Callback callback;
+} sd_req = {SD_ASYNC_IDLE, SD_REQUEST_IDLE, RES_OK};
+
 /**
  * SPI를 사용한 초기화 과정
  *
@@ -33,9 +169,7 @@ DSTATUS SD_Initialize(BYTE pdrv) {
      * To ensure the proper operation of the SD card, the SD CLK signal should
      * have a frequency in the range of 100 to 400 kHz.
      */
-    hspi1.Init.BaudRatePrescaler =
-        SPI_BAUDRATEPRESCALER_256; /* 예: 24 MHz /256 ≈ 94 kHz */
-    HAL_SPI_Init(&hspi1);
+    SD_SetPrescaler(SD_PRESCALER_INIT); /* 예: 24 MHz /256 ≈ 94 kHz */
 
     if (!SD_PowerOn()) {
         return status = STA_NOINIT;
@@ -61,12 +195,14 @@ DSTATUS SD_Initialize(BYTE pdrv) {
                 // CMD55 for Leading ACMD
                 res = SD_Send_Command(SD_CMD55, 0);
                 if (res != SD_RESPONSE_IN_IDLE_STATE) {
+                    SD_Deselect();
                     return status = STA_NOINIT;
                 }
                 // APP Init
                 res = SD_Send_Command(SD_ACMD41, 1 << 30);
             } while (Timer1 && res != 0);
             if (!Timer1) {
+                SD_Deselect();
                 return status = STA_NOINIT;
             }
 
@@ -129,23 +265,136 @@ DSTATUS SD_Initialize(BYTE pdrv) {
     if (sd_version == SD_TYPE_V2_BYTE_ADDRESS || sd_version == SD_TYPE_V1 ||
         sd_version == SD_TYPE_MMC_V3) {
         res = SD_Send_Command(SD_CMD16, 512);
-        if (res == 0) {
-            // increate SPI Clock Speed...?
-            hspi1.Init.BaudRatePrescaler =
-                SPI_BAUDRATEPRESCALER_4; /* 예: 24 MHz /256 ≈ 94 kHz */
-            HAL_SPI_Init(&hspi1);
-        } else {
+        if (res != 0) {
             sd_version = SD_TYPE_UNKNOWN;
         }
     }
 
+    /**
+     * CMD59로 카드의 CRC 검사를 켠다. 이후 모든 명령은 올바른 CRC7을,
+     * 쓰기 데이터 블록은 올바른 CRC16을 가져야 한다.
+     */
+    if (sd_version != SD_TYPE_UNKNOWN && sd_crc_on) {
+        if (SD_Send_Command(SD_CMD59, 1) != 0) {
+            sd_crc_on = false;
+        }
+    }
+
     status &= ~STA_NOINIT;
 
     SD_Deselect();
 
+    /**
+     * 초기화가 끝났으니 카드가 허용하는 만큼 클럭을 올린다. 블록 주소
+     * 카드(SDHC)도 여기서 함께 처리된다.
+     */
+    if (sd_version != SD_TYPE_UNKNOWN) {
+        SD_NegotiateClock();
+    }
+
     return status;
 }
 
+uint32_t SD_GetClock() { return sd_spi_hz; }
+
+/**
+ * CSD의 TRAN_SPEED와 SPI 최대 클럭 중 작은 값을 넘지 않는 가장 빠른 분주비를
+ * 고른 뒤, 알려진 섹터(0번)를 읽어 초기화 클럭에서 읽은 값과 CRC16을
+ * 비교한다. 토큰이나 CRC가 맞지 않으면 한 단계씩 느리게 내린다.
+ * ---------------------------------------------------------------------------
+ * TRAN_SPEED: bits [2:0] transfer rate unit (0=100kbit/s, 1=1Mbit/s,
+ * 2=10Mbit/s, 3=100Mbit/s), bits [6:3] time value (1.0 ~ 8.0)
+ */
+static void SD_NegotiateClock() {
+    static const uint8_t time_value[16] = {0,  10, 12, 13, 15, 20, 25, 30,
+                                           35, 40, 45, 50, 55, 60, 70, 80};
+    static const uint32_t rate_unit[4] = {10000, 100000, 1000000, 10000000};
+    uint8_t  csd[16];
+    uint32_t pclk = HAL_RCC_GetPCLK2Freq();
+    uint32_t max_hz = SD_SPI_MAX_HZ;
+    WORD     ref_crc, crc;
+    uint8_t  idx;
+
+    sd_spi_hz = pclk >> (SD_PRESCALER_INIT + 1);
+
+    if (SD_ReadRegister(SD_CMD9, csd, 16)) {
+        uint32_t tran =
+            rate_unit[csd[3] & 3] * time_value[(csd[3] >> 3) & 0x0F];
+        if ((csd[3] & 7) < 4 && tran != 0 && tran < max_hz) {
+            max_hz = tran;
+        }
+    }
+
+    /* 초기화 클럭에서 읽은 값을 기준으로 삼는다 */
+    if (!SD_ProbeSector(0, &ref_crc)) {
+        return;
+    }
+
+    for (idx = 0; idx < SD_PRESCALER_INIT; idx++) {
+        if ((pclk >> (idx + 1)) <= max_hz) {
+            break;
+        }
+    }
+
+    for (; idx < SD_PRESCALER_INIT; idx++) {
+        SD_SetPrescaler(idx);
+        if (SD_ProbeSector(0, &crc) && crc == ref_crc) {
+            sd_spi_hz = pclk >> (idx + 1);
+            return;
+        }
+    }
+
+    SD_SetPrescaler(SD_PRESCALER_INIT);
+}
+
+/**
+ * CMD17로 한 섹터를 읽으면서 데이터의 CRC16(CCITT)을 계산한다. 카드가 보낸
+ * CRC와 다르거나 데이터 토큰이 오지 않으면 실패.
+ */
+static bool SD_ProbeSector(DWORD sector, WORD *crc) {
+    uint8_t dummy = 0xFF, token, data;
+    WORD    calc = 0, recv;
+    bool    ok   = SD_ERROR;
+
+    SD_Select();
+    if (SD_Send_Command(SD_CMD17, SD_SectorToAddress(sector)) == 0) {
+        Timer1 = 200;
+        do {
+            SD_SPI_SendReceive(dummy, &token);
+        } while (Timer1 && token == 0xFF);
+
+        if (token == SD_DATA_TOKEN_CMD17_18_24) {
+            for (UINT i = 0; i < 512; i++) {
+                SD_SPI_SendReceive(dummy, &data);
+                calc = (calc << 8) ^ sd_crc16_table[(calc >> 8) ^ data];
+            }
+            SD_SPI_SendReceive(dummy, &data);
+            recv = (WORD)data << 8;
+            SD_SPI_SendReceive(dummy, &data);
+            recv |= data;
+
+            if (recv == calc) {
+                *crc = calc;
+                ok   = SD_OK;
+            }
+        }
+    }
+    SD_Deselect();
+    return ok;
+}
+
+static void SD_SetPrescaler(uint8_t idx) {
+#if SD_USE_SPI_BUS
+    /**
+     * CR1의 BR만 바꾼다. 다른 장치가 쓰는 중이면 다음 Select에서 적용된다.
+     */
+    SPI_Bus_SetPrescaler(SD_BUS, &sd_bus_dev, sd_prescalers[idx]);
+#else
+    hspi1.Init.BaudRatePrescaler = sd_prescalers[idx];
+    HAL_SPI_Init(&hspi1);
+#endif
+}
+
 static bool SD_PowerOn() {
     uint8_t res, dummy = 0xFF, n = 0xFF;
     /**
@@ -159,8 +408,14 @@ static bool SD_PowerOn() {
      * have occurred, your program should set the CS line to 0 and send the
      * command CMD0: 01 000000 00000000 00000000 00000000 00000000 1001010 1
      */
-
-    SD_Deselect();
+#if SD_USE_SPI_BUS
+    /**
+     * 초기화 클럭도 SD 카드 설정(/256, 모드 0)으로 나가야 하므로 버스를 먼저
+     * 잡고 CS만 High로 되돌린다.
+     */
+    SPI_Bus_Acquire(SD_BUS, &sd_bus_dev);
+#endif
+    HAL_GPIO_WritePin(CS_GPIO_Port, CS_Pin, GPIO_PIN_SET);
     for (int i = 0; i < 10; i++) {
         SD_SPI_Send(0xFF);
     }
@@ -197,26 +452,102 @@ static bool SD_PowerOn() {
 }
 
 static void SD_Select() {
+#if SD_USE_SPI_BUS
+    /**
+     * 버스를 얻으면 분주비가 적용되고 CS가 Low가 된다.
+     */
+    SPI_Bus_Acquire(SD_BUS, &sd_bus_dev);
+    /* 이미 버스를 쥐고 있으면(SD_PowerOn) CS만 내린다 */
+    HAL_GPIO_WritePin(CS_GPIO_Port, CS_Pin, GPIO_PIN_RESET);
+#else
     HAL_GPIO_WritePin(CS_GPIO_Port, CS_Pin, GPIO_PIN_RESET);
+#endif
 }
 
 static void SD_Deselect() {
+#if SD_USE_SPI_BUS
+    if (!SPI_Bus_IsOwner(SD_BUS, &sd_bus_dev)) {
+        return;
+    }
+#endif
     HAL_GPIO_WritePin(CS_GPIO_Port, CS_Pin, GPIO_PIN_SET);
+    /**
+     * MMC와 SDC가 각각 응답을 처리하는 타이밍이 달라서, 강제로 8비트 정도
+     * 출력을 해야 정상적으로 동작한다.
+     * (이 내용은 https://elm-chan.org/docs/mmc/mmc_e.html#spibus 여기서
+     * 찾았다.)
+     * -----------------------------------------------------------------------
+     * Right waveforms show the MISO line drive/release timing of the MMC/SDC
+     * (the DO signal is pulled to 1/2 vcc to see the bus state). Therefore to
+     * make MMC/SDC release the MISO line, the master device needs to send a
+     * byte after the CS signal is deasserted.
+     */
+    SD_SPI_Send(0xFF);
+#if SD_USE_SPI_BUS
+    /* MISO를 놓은 뒤에 다음 장치에게 넘긴다 */
+    SPI_Bus_Release(SD_BUS, &sd_bus_dev);
+#endif
+}
+
+#if SD_USE_SPI_BUS
+static void SD_BusPoll() { SD_PollAsync(); }
+
+/**
+ * 양보했던 요청을 이어가기 전에 버스를 다시 잡는다. 못 잡으면 다음 폴링에서
+ * 다시 시도한다.
+ */
+static bool SD_BusResume() {
+    return SPI_Bus_TryAcquire(SD_BUS, &sd_bus_dev);
+}
+
+/**
+ * 쓰기 블록 사이에서만 호출한다. CS가 High인 동안 카드는 클럭을 무시하므로
+ * 다시 선택하면 busy 대기부터 이어진다.
+ */
+static void SD_BusYield() {
+    if (SPI_Bus_HasWaiter(SD_BUS, sd_bus_dev.priority)) {
+        SD_Deselect();
+    }
 }
 
+/**
+ * CMD18 도중에는 CS를 올려도 카드가 다음 블록을 계속 준비하므로, 읽기는
+ * CMD12로 전송을 끝낸 뒤에 비켜준다. 버스를 다시 잡으면
+ * SD_ASYNC_READ_RESTART에서 남은 섹터부터 새로 요청한다.
+ */
+static void SD_BusYieldRead() {
+    if (!SPI_Bus_HasWaiter(SD_BUS, sd_bus_dev.priority)) {
+        return;
+    }
+    if (sd_req.multi) {
+        SD_Send_Command(SD_CMD12, 0);
+    }
+    sd_req.state = SD_ASYNC_READ_RESTART;
+    SD_Deselect();
+}
+#endif
+
 SD_Response SD_Send_Command(SD_Command_Type cmd, DWORD arg) {
     uint8_t     crc   = 0x01;
     uint8_t     dummy = 0xFF;
     uint32_t    n     = 0xFF;
     SD_Response res;
 
-    SD_BusyWait();
+    /**
+     * CMD12는 CMD18로 데이터 블록이 계속 전송되는 도중에 보내야 하므로, busy
+     * 대기를 하면 데이터 바이트를 읽어버리게 된다.
+     */
+    if (cmd != SD_CMD12) {
+        SD_BusyWait();
+    }
 
     /**
      * CMD0, CMD8, CMD58의 경우 고정된 CRC값을 포함해야함. 나머지 명령어의 경우
-     * 신경쓰지 않는다.
+     * 신경쓰지 않는다. CRC 모드에서는 모든 명령의 CRC7을 계산한다.
      */
-    if (cmd == SD_CMD0) {
+    if (sd_crc_on) {
+        crc = SD_CRC7(cmd, arg);
+    } else if (cmd == SD_CMD0) {
         crc = SD_CMD0_CRC;
     } else if (cmd == SD_CMD8) {
         crc = SD_CMD8_CRC;
@@ -234,6 +565,16 @@ SD_Response SD_Send_Command(SD_Command_Type cmd, DWORD arg) {
     SD_SPI_Send((BYTE)(arg));
     SD_SPI_Send(crc);
 
+    /**
+     * CMD12 직후 1바이트는 stuff byte이므로 버린다.
+     * ---------------------------------------------------------------------
+     * The received byte immediataly following CMD12 is a stuff byte, it
+     * should be discarded prior to receive the response of the CMD12.
+     */
+    if (cmd == SD_CMD12) {
+        SD_SPI_SendReceive(dummy, &res);
+    }
+
     /**
      * 일반적인 SPI 수신 절차에 따라 8번 클럭을 토글하기 위해 MOSI를 high로 둔
      * 더미데이터 전송.
@@ -280,6 +621,121 @@ static void SD_SPI_SendReceive(BYTE request, BYTE *response) {
         ;
     HAL_SPI_TransmitReceive(&hspi1, &request, response, 1, SD_SPI_TIMEOUT_MS);
 }
+/**
+ * 바이트마다 HAL을 호출하면 CPU 시간이 SPI 클럭보다 오래 걸리므로, 데이터
+ * 블록은 한 번의 전송으로 처리한다.
+ * tx가 NULL이면 0xFF를 보내면서 수신하고, rx가 NULL이면 송신만 한다.
+ * DMA를 쓰면 전송을 시작만 하고 돌아오며, 완료는 sd_dma_busy로 확인한다.
+ */
+static bool SD_SPI_StartBlock(const BYTE *tx, BYTE *rx, UINT len) {
+    HAL_StatusTypeDef ret;
+
+    if (tx == NULL) {
+        tx = sd_dummy_block;
+    }
+
+    while (HAL_SPI_GetState(&hspi1) != HAL_SPI_STATE_READY)
+        ;
+#if SD_USE_DMA
+    sd_dma_busy = true;
+    Timer2      = SD_SPI_TIMEOUT_MS;
+    if (rx != NULL) {
+        ret = HAL_SPI_TransmitReceive_DMA(&hspi1, (uint8_t *)tx, rx, len);
+    } else {
+        ret = HAL_SPI_Transmit_DMA(&hspi1, (uint8_t *)tx, len);
+    }
+    if (ret != HAL_OK) {
+        sd_dma_busy = false;
+        return SD_ERROR;
+    }
+#elif SD_BLOCK_BYTE_LOOP
+    UNUSED(ret);
+    for (UINT i = 0; i < len; i++) {
+        if (rx != NULL) {
+            SD_SPI_SendReceive(tx[i], &rx[i]);
+        } else {
+            SD_SPI_Send(tx[i]);
+        }
+    }
+#else
+    if (rx != NULL) {
+        ret = HAL_SPI_TransmitReceive(&hspi1, (uint8_t *)tx, rx, len,
+                                      SD_SPI_TIMEOUT_MS);
+    } else {
+        ret = HAL_SPI_Transmit(&hspi1, (uint8_t *)tx, len, SD_SPI_TIMEOUT_MS);
+    }
+    if (ret != HAL_OK) {
+        return SD_ERROR;
+    }
+#endif
+    return SD_OK;
+}
+
+
+void SD_SPI_DMA_CpltCallback(void) { sd_dma_busy = false; }
+
+/**
+ * 명령 프레임의 CRC7(x^7 + x^3 + 1). 끝 비트(1)까지 붙여서 반환한다.
+ */
+static BYTE SD_CRC7(BYTE cmd, DWORD arg) {
+    BYTE frame[5] = {cmd, (BYTE)(arg >> 24), (BYTE)(arg >> 16),
+                     (BYTE)(arg >> 8), (BYTE)arg};
+    BYTE crc      = 0;
+
+    for (int i = 0; i < 5; i++) {
+        BYTE d = frame[i];
+        for (int b = 0; b < 8; b++) {
+            crc <<= 1;
+            if ((d ^ crc) & 0x80) {
+                crc ^= 0x09;
+            }
+            d <<= 1;
+        }
+    }
+    return (BYTE)((crc << 1) | 1);
+}
+
+static WORD SD_CRC16(const BYTE *buff, UINT len) {
+    WORD crc = 0;
+
+    while (len--) {
+        crc = (crc << 8) ^ sd_crc16_table[(crc >> 8) ^ *buff++];
+    }
+    return crc;
+}
+
+/**
+ * 전송이 끝난 데이터 블록의 CRC16. CRC 모드가 꺼져 있으면 계산하지 않는다.
+ */
+static WORD SD_BlockCRC(const BYTE *block) {
+    if (!sd_crc_on) {
+        return 0;
+    }
+    return SD_CRC16(block, 512);
+}
+
+bool SD_SetCRC(bool enable) {
+    bool prev = sd_crc_on, ok;
+
+    if (SD_IsAsyncBusy()) {
+        SD_WaitAsync();
+    }
+
+    /* 카드가 CRC를 검사 중일 수 있으므로 CMD59에는 항상 CRC7을 붙인다 */
+    sd_crc_on = true;
+    SD_Select();
+    ok = SD_Send_Command(SD_CMD59, enable ? 1 : 0) == 0;
+    SD_Deselect();
+
+    sd_crc_on = ok ? enable : prev;
+    return ok;
+}
+
+bool SD_IsCRCEnabled() { return sd_crc_on; }
+
+void SD_GetCRCStats(SD_CRC_Stats *out) { *out = sd_crc_stats; }
+
+void SD_ResetCRCStats() { memset(&sd_crc_stats, 0, sizeof(sd_crc_stats)); }
 
 static void SD_SPI_ReceiveInformation(SD_Information info) {
     /**
@@ -298,10 +754,9 @@ DSTATUS SD_Status(BYTE pdrv) { return status; }
 SD_Version_Type SD_GetVersion() { return sd_version; }
 
 DSTATUS SD_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
-    SD_Response r;
-    uint8_t     csd[32];
-    uint8_t     dummy = 0xFF;
-    DSTATUS     res   = RES_OK;
+    uint8_t csd[16];
+    DWORD   csize, n;
+    DSTATUS res = RES_OK;
 
     if (cmd == CTRL_SYNC) {
         /**
@@ -330,6 +785,12 @@ DSTATUS SD_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
          */
         // Timer2 = 1000;
 
+        /**
+         * 진행 중인 비동기 요청이 있다면 먼저 끝낸다.
+         */
+        if (SD_IsAsyncBusy() && SD_WaitAsync() != RES_OK) {
+            res = RES_ERROR;
+        }
         if (!SD_BusyWait()) {
             res = RES_ERROR;
         }
@@ -344,129 +805,581 @@ DSTATUS SD_ioctl(BYTE pdrv, BYTE cmd, void *buff) {
          * bytes/sector.
          */
         *(WORD *)buff = 512; // 왜 512?
+    } else if (cmd == GET_SECTOR_COUNT) {
+        /**
+         * CSD의 C_SIZE로 전체 섹터 수를 계산한다.
+         * ---------------------------------------------------------------------
+         * CSD Version 2.0: memory capacity = (C_SIZE+1) * 512KByte
+         * CSD Version 1.0: memory capacity = BLOCKNR * BLOCK_LEN
+         *   BLOCKNR = (C_SIZE+1) * 2^(C_SIZE_MULT+2), BLOCK_LEN = 2^READ_BL_LEN
+         */
+        if (SD_ReadRegister(SD_CMD9, csd, 16)) {
+            if (SD_GET_CSD_STRUCTURE_VERSION(SD_CSD_WORD(csd, 0)) ==
+                SD_CSD_VERSION_2) {
+                csize = SD_GET_SECTOR_COUNT_ON_CSD_VERSION_2(
+                            SD_CSD_WORD(csd, 1), SD_CSD_WORD(csd, 2)) +
+                        1;
+                *(DWORD *)buff = csize << 10;
+            } else {
+                n = (csd[5] & 15) + ((csd[10] & 128) >> 7) +
+                    ((csd[9] & 3) << 1) + 2;
+                csize = (csd[8] >> 6) + ((WORD)csd[7] << 2) +
+                        ((WORD)(csd[6] & 3) << 10) + 1;
+                *(DWORD *)buff = csize << (n - 9);
+            }
+        } else {
+            res = RES_ERROR;
+        }
     } else if (cmd == GET_BLOCK_SIZE) {
-        *(DWORD *)buff = 8;
+        /**
+         * 지우기 단위(섹터 수). SDv2는 SD Status(ACMD13)의 AU_SIZE를,
+         * SDv1/MMC는 CSD의 SECTOR_SIZE/ERASE_GRP 값을 사용한다.
+         */
+        if (sd_version == SD_TYPE_V2_BLOCK_ADDRESS ||
+            sd_version == SD_TYPE_V2_BYTE_ADDRESS) {
+            uint8_t sd_status[64];
+            if (SD_ReadRegister(SD_ACMD13, sd_status, 64)) {
+                *(DWORD *)buff = 16UL << (sd_status[10] >> 4);
+            } else {
+                res = RES_ERROR;
+            }
+        } else if (SD_ReadRegister(SD_CMD9, csd, 16)) {
+            if (sd_version == SD_TYPE_V1) {
+                *(DWORD *)buff = (((csd[10] & 63) << 1) +
+                                  ((WORD)(csd[11] & 128) >> 7) + 1)
+                                 << ((csd[13] >> 6) - 1);
+            } else {
+                *(DWORD *)buff = ((WORD)((csd[10] & 124) >> 2) + 1) *
+                                 (((csd[11] & 3) << 3) +
+                                  ((csd[11] & 224) >> 5) + 1);
+            }
+        } else {
+            res = RES_ERROR;
+        }
+    } else if (cmd == CTRL_TRIM) {
+        /**
+         * buff는 {시작 섹터, 끝 섹터}. CMD32/CMD33으로 범위를 지정하고
+         * CMD38로 지운다. 지우는 데 오래 걸릴 수 있으므로 busy를 길게
+         * 기다린다.
+         */
+        DWORD *range = (DWORD *)buff;
+
+        if (sd_version == SD_TYPE_MMC_V3 || !SD_ReadRegister(SD_CMD9, csd, 16)) {
+            res = RES_ERROR;
+        } else if (SD_GET_CSD_STRUCTURE_VERSION(SD_CSD_WORD(csd, 0)) ==
+                       SD_CSD_VERSION_1 &&
+                   !(csd[10] & 0x40)) {
+            /* ERASE_BLK_EN이 0이면 섹터 단위로 지울 수 없다 */
+            res = RES_ERROR;
+        } else {
+            SD_Select();
+            if (SD_Send_Command(SD_CMD32, SD_SectorToAddress(range[0])) != 0 ||
+                SD_Send_Command(SD_CMD33, SD_SectorToAddress(range[1])) != 0 ||
+                SD_Send_Command(SD_CMD38, 0) != 0 ||
+                !SD_BusyWaitFor(SD_ERASE_TIMEOUT_MS)) {
+                res = RES_ERROR;
+            }
+            SD_Deselect();
+        }
+    } else if (cmd == MMC_GET_CSD) {
+        if (!SD_ReadRegister(SD_CMD9, (BYTE *)buff, 16)) {
+            res = RES_ERROR;
+        }
+    } else if (cmd == MMC_GET_CID) {
+        if (!SD_ReadRegister(SD_CMD10, (BYTE *)buff, 16)) {
+            res = RES_ERROR;
+        }
     } else {
         res = RES_PARERR;
     }
     return res;
 }
 
+/**
+ * CSD(CMD9), CID(CMD10), SD Status(ACMD13)처럼 데이터 블록으로 오는 레지스터를
+ * 읽는다.
+ */
+static bool SD_ReadRegister(SD_Command_Type cmd, BYTE *buff, UINT len) {
+    SD_Response res;
+    uint8_t     dummy = 0xFF, token;
+    bool        ok    = SD_ERROR;
+
+    if (SD_IsAsyncBusy()) {
+        SD_WaitAsync();
+    }
+
+    SD_Select();
+    if (cmd == SD_ACMD13) {
+        SD_Send_Command(SD_CMD55, 0);
+    }
+    res = SD_Send_Command(cmd, 0);
+    if (cmd == SD_ACMD13) {
+        /* R2 응답이므로 1바이트 더 받는다 */
+        SD_SPI_SendReceive(dummy, &token);
+    }
+
+    if (res == 0) {
+        Timer1 = 200;
+        do {
+            SD_SPI_SendReceive(dummy, &token);
+        } while (Timer1 && token == 0xFF);
+
+        if (token == SD_DATA_TOKEN_CMD17_18_24) {
+            for (UINT i = 0; i < len; i++) {
+                SD_SPI_SendReceive(dummy, &buff[i]);
+            }
+            /* CRC */
+            SD_SPI_Send(dummy);
+            SD_SPI_Send(dummy);
+            ok = SD_OK;
+        }
+    }
+
+    SD_Deselect();
+    return ok;
+}
+
+/**
+ * 명령 요청 후에는 항상 CmdResponse가 먼저 응답된다. 그 이후 DataPacket이
+ * 전달된다. DataPacket은 Token + Block + CRC를 의미한다. CMD12(Stop
+ * Transmission)은 Token만 전달되고 Block과 CRC는 전달되지 않는다.
+ * ------------------------------------------------------------------------
+ * The data block is transferred as a data packet that consist of Token,
+ * Data Block and CRC. The format of the data packet is showin in right
+ * image and there are three data tokens. Stop Tran token is to terminate a
+ * multiple block write transaction, it is used as single byte packet
+ * without data block and CRC.
+ *
+ * FatFs에서 쓰는 블로킹 함수는 비동기 요청을 넣고 끝날 때까지 기다린다.
+ */
 DSTATUS SD_Read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count) {
+    if (count == 0) {
+        return RES_PARERR;
+    }
+    SD_WaitAsync();
+    if (!SD_ReadAsync(buff, sector, count, NULL)) {
+        return RES_ERROR;
+    }
+    return SD_WaitAsync();
+}
+
+DSTATUS SD_Write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count) {
+    if (count == 0) {
+        return RES_PARERR;
+    }
+    SD_WaitAsync();
+    if (!SD_WriteAsync(buff, sector, count, NULL)) {
+        return RES_ERROR;
+    }
+    return SD_WaitAsync();
+}
+
+/**
+ * 메모리상 흩어져 있는 블록들을 연속된 섹터에 한 번의 CMD25로 쓴다.
+ * (sd_cache에서 dirty 섹터들을 모아서 쓸 때 사용)
+ */
+DSTATUS SD_WriteBlocks(BYTE pdrv, const BYTE *const *blocks, DWORD sector,
+                       UINT count) {
+    if (count == 0) {
+        return RES_PARERR;
+    }
+    SD_WaitAsync();
+    if (!SD_StartWrite(NULL, blocks, sector, count, NULL)) {
+        return RES_ERROR;
+    }
+    return SD_WaitAsync();
+}
+
+static DWORD SD_SectorToAddress(DWORD sector) {
+    return (sd_version == SD_TYPE_V2_BLOCK_ADDRESS)
+               ? sector        /* SDHC/SDXC: block address */
+               : sector * 512; /* SDSC: byte address */
+}
+
+/**
+ * 명령만 보내고 곧바로 돌아온다. 토큰 대기, 데이터 블록 전송, 카드 busy 대기는
+ * SD_PollAsync를 호출할 때마다 조금씩 진행된다.
+ * todo: SD_Send_Command 함수는 초기화를 위해 작성되어서, 읽기쓰기작업이
+ * 완료된 후 CS핀이 high로 바뀌어야 함을 간과했다. 요청 단위로 CS를 직접
+ * 관리하여 문제를 회피했다.
+ */
+bool SD_ReadAsync(BYTE *buff, DWORD sector, UINT count,
+                  SD_Request_Callback callback) {
+    SD_Response res;
+
+    if (count == 0 || sd_req.state != SD_ASYNC_IDLE) {
+        return SD_ERROR;
+    }
+
+    SD_Select();
     /**
-     * 명령 요청 후에는 항상 CmdResponse가 먼저 응답된다. 그 이후 DataPacket이
-     * 전달된다. DataPacket은 Token + Block + CRC를 의미한다. CMD12(Stop
-     * Transmission)은 Token만 전달되고 Block과 CRC는 전달되지 않는다.
-     * ------------------------------------------------------------------------
-     * The data block is transferred as a data packet that consist of Token,
-     * Data Block and CRC. The format of the data packet is showin in right
-     * image and there are three data tokens. Stop Tran token is to terminate a
-     * multiple block write transaction, it is used as single byte packet
-     * without data block and CRC.
+     * CMD18을 보내면 CMD12를 보낼 때까지 카드가 다음 블록들을 연속으로
+     * 보내준다. 블록마다 DataToken + DataBlock + CRC 형태로 온다.
+     * ---------------------------------------------------------------------
+     * The Multiple Block Read command (CMD18) starts a series of data
+     * packets. The card continues to send data packets until the host
+     * sends CMD12 (STOP_TRANSMISSION).
      */
-    SD_DataToken token;
-    SD_Response  res;
-    uint8_t      dummy = 0xFF, crc = 0x01;
-    DWORD        addr = (sd_version == SD_TYPE_V2_BLOCK_ADDRESS)
-                            ? sector        /* SDHC/SDXC: block address */
-                            : sector * 512; /* SDSC: byte address */
+    res = SD_Send_Command(count > 1 ? SD_CMD18 : SD_CMD17,
+                          SD_SectorToAddress(sector));
+    if (res != 0) {
+        SD_Deselect();
+        return SD_ERROR;
+    }
+
+    sd_req.rbuff    = buff;
+    sd_req.wbuff    = NULL;
+    sd_req.wblocks  = NULL;
+    sd_req.sector   = sector;
+    sd_req.count    = count;
+    sd_req.multi    = count > 1;
+    sd_req.retry    = false;
+    sd_req.retries  = 0;
+    sd_req.callback = callback;
+    sd_req.result   = RES_OK;
+    sd_req.status   = SD_REQUEST_BUSY;
+    sd_req.state    = SD_ASYNC_READ_WAIT_TOKEN;
+    Timer1          = 200; // 토큰 타임아웃 200ms
+    return SD_OK;
+}
+
+bool SD_WriteAsync(const BYTE *buff, DWORD sector, UINT count,
+                   SD_Request_Callback callback) {
+    return SD_StartWrite(buff, NULL, sector, count, callback);
+}
+
+static bool SD_StartWrite(const BYTE *buff, const BYTE *const *blocks,
+                          DWORD sector, UINT count,
+                          SD_Request_Callback callback) {
+    SD_Response res;
 
+    if (count == 0 || sd_req.state != SD_ASYNC_IDLE) {
+        return SD_ERROR;
+    }
+
+    SD_Select();
     if (count == 1) {
+        res = SD_Send_Command(SD_CMD24, SD_SectorToAddress(sector));
+    } else {
+#if SD_USE_ACMD23_PRE_ERASE
+        /**
+         * 연속으로 쓸 블록 수를 미리 알려주면 카드가 해당 영역을 미리
+         * 지워두므로 쓰기 속도가 빨라진다. MMC는 지원하지 않는다.
+         * ---------------------------------------------------------------------
+         * Setting a number of write blocks to be pre-erased before writing
+         * (to be used for faster Multiple Block WR command).
+         */
+        if (sd_version != SD_TYPE_MMC_V3) {
+            SD_Send_Command(SD_CMD55, 0);
+            SD_Send_Command(SD_ACMD23, count);
+        }
+#endif
         /**
-         * read single block
-         * request and receive token
-         * todo: SD_Send_Command 함수는 초기화를 위해 작성되어서, 읽기쓰기작업이
-         * 완료된 후 CS핀이 high로 바뀌어야 함을 간과했다. 일단 내부 구현을
-         * 그대로 옮겨와 작성하여 문제를 회피했다.
+         * 블록마다 0xFC 토큰을 붙여 보내고, 끝나면 0xFD(Stop Tran) 토큰만
+         * 보낸다.
          */
-        SD_Select();
+        res = SD_Send_Command(SD_CMD25, SD_SectorToAddress(sector));
+    }
+    if (res != 0) {
+        SD_Deselect();
+        return SD_ERROR;
+    }
 
-        res = SD_Send_Command(SD_CMD17, addr);
+    sd_req.rbuff    = NULL;
+    sd_req.wbuff    = buff;
+    sd_req.wblocks  = blocks;
+    sd_req.sector   = sector;
+    sd_req.count    = count;
+    sd_req.multi    = count > 1;
+    sd_req.retry    = false;
+    sd_req.retries  = 0;
+    sd_req.callback = callback;
+    sd_req.result   = RES_OK;
+    sd_req.status   = SD_REQUEST_BUSY;
+    sd_req.state    = SD_ASYNC_WRITE_WAIT_READY;
+    Timer2          = 500;
+    return SD_OK;
+}
 
-        if (res == 0) {
-            /**
-             * Read DataToken
-             */
-            Timer1 = 200; // 타임아웃 200ms
-            do {
-                SD_SPI_SendReceive(dummy, &token);
-            } while (Timer1 && token == 0xFF);
-            /**
-             * 에러 토큰 검사
-             */
-            if (token != 0xFE) {
-                SD_Deselect();
-                SD_SPI_Send(0xFF);
-                return RES_ERROR;
+/**
+ * 슈퍼루프에서 주기적으로 호출한다. 한 번 호출할 때 최대 1바이트의 폴링이나
+ * 블록 전송 시작만 하므로 오래 붙잡혀 있지 않는다.
+ */
+SD_Request_Status SD_PollAsync() {
+    uint8_t         dummy = 0xFF;
+    uint8_t         res;
+    SD_DataResponse data_res;
+    WORD            crc, recv_crc;
+
+#if SD_USE_SPI_BUS
+    if (sd_req.state != SD_ASYNC_IDLE && !SD_BusResume()) {
+        return sd_req.status;
+    }
+#endif
+
+    switch (sd_req.state) {
+    case SD_ASYNC_READ_WAIT_TOKEN:
+        SD_SPI_SendReceive(dummy, &res);
+        if (res == 0xFF) {
+            if (!Timer1) {
+                SD_FinishAsync(RES_ERROR);
+            }
+            break;
+        }
+        /**
+         * 에러 토큰 검사
+         */
+        if (res != SD_DATA_TOKEN_CMD17_18_24 ||
+            !SD_SPI_StartBlock(NULL, sd_req.rbuff, 512)) {
+            SD_FinishAsync(RES_ERROR);
+            break;
+        }
+        sd_req.state = SD_ASYNC_READ_DATA;
+        break;
+
+    case SD_ASYNC_READ_DATA:
+        if (sd_dma_busy) {
+            if (!Timer2) {
+                HAL_SPI_Abort(&hspi1);
+                sd_dma_busy = false;
+                SD_FinishAsync(RES_ERROR);
             }
+            break;
+        }
+        crc = SD_BlockCRC(sd_req.rbuff);
+        SD_SPI_SendReceive(dummy, &res);
+        recv_crc = (WORD)res << 8;
+        SD_SPI_SendReceive(dummy, &res);
+        recv_crc |= res;
+
+        if (sd_crc_on) {
+            sd_crc_stats.blocks++;
+            if (crc != recv_crc) {
+                /**
+                 * 이 블록부터 다시 읽는다.
+                 */
+                sd_crc_stats.errors++;
+                if (!SD_RetryRequest()) {
+                    SD_FinishAsync(RES_ERROR);
+                }
+                break;
+            }
+        }
+
+        sd_req.rbuff += 512;
+        sd_req.sector++;
+        if (--sd_req.count) {
+            Timer1       = 200;
+            sd_req.state = SD_ASYNC_READ_WAIT_TOKEN;
+#if SD_USE_SPI_BUS
+            SD_BusYieldRead();
+#endif
+        } else {
+            SD_FinishAsync(RES_OK);
+        }
+        break;
+
+    case SD_ASYNC_READ_RESTART:
+        /**
+         * 양보하느라 멈췄던 읽기를 남은 섹터부터 다시 요청한다.
+         */
+        sd_req.multi = sd_req.count > 1;
+        if (SD_Send_Command(sd_req.multi ? SD_CMD18 : SD_CMD17,
+                            SD_SectorToAddress(sd_req.sector)) != 0) {
+            SD_FinishAsync(RES_ERROR);
+            break;
+        }
+        Timer1       = 200;
+        sd_req.state = SD_ASYNC_READ_WAIT_TOKEN;
+        break;
 
+    case SD_ASYNC_WRITE_WAIT_READY:
+        /**
+         * 이전 블록의 프로그래밍이 끝날 때까지(0xFF 수신) 대기
+         */
+        SD_SPI_SendReceive(dummy, &res);
+        if (res != 0xFF) {
+            if (!Timer2) {
+                SD_FinishAsync(RES_ERROR);
+            }
+            break;
+        }
+        if (sd_req.count == 0 || sd_req.retry) {
             /**
-             * Read DataBlock
+             * Stop Tran 토큰 이후 1바이트 뒤부터 busy가 시작된다.
              */
-            for (UINT i = 0; i < 512; i++) {
-                SD_SPI_SendReceive(dummy, &buff[i]);
+            SD_SPI_Send(SD_STOP_DATA_TOKEN_CMD25);
+            SD_SPI_Send(dummy);
+            Timer2       = 500;
+            sd_req.state = SD_ASYNC_WRITE_WAIT_BUSY;
+            break;
+        }
+        SD_SPI_Send(sd_req.multi ? SD_DATA_TOKEN_CMD25
+                                 : SD_DATA_TOKEN_CMD17_18_24);
+        if (!SD_SPI_StartBlock(sd_req.wblocks ? *sd_req.wblocks : sd_req.wbuff,
+                               NULL, 512)) {
+            SD_FinishAsync(RES_ERROR);
+            break;
+        }
+        sd_req.state = SD_ASYNC_WRITE_DATA;
+        break;
+
+    case SD_ASYNC_WRITE_DATA:
+        if (sd_dma_busy) {
+            if (!Timer2) {
+                HAL_SPI_Abort(&hspi1);
+                sd_dma_busy = false;
+                SD_FinishAsync(RES_ERROR);
             }
+            break;
+        }
+        crc = SD_BlockCRC(sd_req.wblocks ? *sd_req.wblocks : sd_req.wbuff);
+        SD_SPI_Send(sd_crc_on ? (BYTE)(crc >> 8) : 0xFF); /* CRC */
+        SD_SPI_Send(sd_crc_on ? (BYTE)crc : 0xFF);
 
+        SD_SPI_SendReceive(dummy, &data_res);
+        if (sd_crc_on) {
+            sd_crc_stats.blocks++;
+        }
+        if (sd_crc_on && SD_IS_DATA_REJECTED_WITH_CRC_ERROR(data_res) &&
+            sd_req.retries < SD_CRC_RETRIES) {
+            /**
+             * 카드가 CRC 오류로 거절한 블록은 쓰기를 끝낸 뒤 다시 요청한다.
+             */
+            sd_crc_stats.errors++;
+            sd_req.retry = true;
+        } else if (!SD_IS_DATA_ACCEPTED(data_res)) {
             /**
-             * Read CRC, but skip
+             * 거절되면 남은 블록은 보내지 않고 전송을 끝낸다.
              */
-            SD_SPI_Send(crc);
-            SD_SPI_Send(crc);
+            sd_req.result = RES_ERROR;
+            sd_req.count  = 0;
+        } else {
+            if (sd_req.wblocks) {
+                sd_req.wblocks++;
+            } else {
+                sd_req.wbuff += 512;
+            }
+            sd_req.sector++;
+            sd_req.count--;
+        }
 
-            SD_Deselect();
+        Timer2 = 500;
+        if (sd_req.multi) {
+            sd_req.state = SD_ASYNC_WRITE_WAIT_READY;
         } else {
-            return RES_ERROR;
+            sd_req.state = SD_ASYNC_WRITE_WAIT_BUSY;
         }
+#if SD_USE_SPI_BUS
+        SD_BusYield();
+#endif
+        break;
 
-    } else {
+    case SD_ASYNC_WRITE_WAIT_BUSY:
+        /**
+         * 카드가 내부적으로 쓰기(프로그래밍)를 마칠 때까지 대기
+         */
+        SD_SPI_SendReceive(dummy, &res);
+        if (res != 0xFF) {
+            if (!Timer2) {
+                SD_FinishAsync(RES_ERROR);
+            }
+            break;
+        }
+        if (sd_req.retry) {
+            if (!SD_RetryRequest()) {
+                SD_FinishAsync(RES_ERROR);
+            }
+            break;
+        }
+        SD_FinishAsync(RES_OK);
+        break;
+
+    case SD_ASYNC_IDLE:
+    default:
+        break;
     }
-    return RES_OK;
+
+    return sd_req.status;
 }
 
-DSTATUS SD_Write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count) {
-    SD_DataResponse data_res;
-    SD_Response     res;
-    uint8_t         dummy = 0xFF;
+bool SD_IsAsyncBusy() { return sd_req.state != SD_ASYNC_IDLE; }
 
-    SD_Select();
-    if (count == 1) {
-        data_res = (SD_DataResponse)SD_Send_Command(SD_CMD24, sector);
+/**
+ * CRC 오류가 난 블록부터 남은 블록들을 다시 요청한다. 읽기는 진행 중인
+ * CMD18을 멈추고, 쓰기는 이미 Stop Tran/busy를 마친 상태에서 호출된다.
+ */
+static bool SD_RetryRequest() {
+    SD_Response res;
+    bool        read = sd_req.rbuff != NULL;
 
-        if (data_res == 0) {
-            /**
-             * 0. 더미 1바이트 전송
-             * 1. 데이터 토큰 전송
-             * 2. 데이터 블록 전송
-             * 3. CRC 전송
-             * 4. busy flag 처리
-             */
-            uint8_t token = SD_DATA_TOKEN_CMD17_18_24;
-            uint8_t crc   = 0xFF;
+    if (sd_req.retries >= SD_CRC_RETRIES) {
+        return SD_ERROR;
+    }
+    sd_req.retries++;
+    sd_crc_stats.retries++;
 
-            SD_SPI_Send(dummy);
-            SD_SPI_Send(token);
+    if (read && sd_req.multi) {
+        SD_Send_Command(SD_CMD12, 0);
+    }
 
-            for (int i = 0; i < 512; i++) {
-                SD_SPI_Send(*(buff++));
-            }
-            SD_SPI_Send(crc);
-            SD_SPI_Send(crc);
-
-            SD_SPI_SendReceive(dummy, &data_res);
-            if (SD_IS_DATA_ACCEPTED(data_res)) {
-                do {
-                    SD_SPI_SendReceive(dummy, &res);
-                } while (res != 0xFF);
-            }
-        }
+    sd_req.multi = sd_req.count > 1;
+    sd_req.retry = false;
+    if (read) {
+        res = SD_Send_Command(sd_req.multi ? SD_CMD18 : SD_CMD17,
+                              SD_SectorToAddress(sd_req.sector));
+        Timer1       = 200;
+        sd_req.state = SD_ASYNC_READ_WAIT_TOKEN;
     } else {
+        res = SD_Send_Command(sd_req.multi ? SD_CMD25 : SD_CMD24,
+                              SD_SectorToAddress(sd_req.sector));
+        Timer2       = 500;
+        sd_req.state = SD_ASYNC_WRITE_WAIT_READY;
+    }
+    if (res != 0) {
+        /* 명령이 실패하면 CMD12를 다시 보낼 필요가 없다 */
+        sd_req.multi = false;
+        return SD_ERROR;
+    }
+    return SD_OK;
+}
+
+static void SD_FinishAsync(DRESULT result) {
+    SD_Request_Callback callback = sd_req.callback;
+
+    /**
+     * 중간에 실패했더라도 읽기 전송은 멈춰야 한다.
+     */
+    if (sd_req.multi && (sd_req.state == SD_ASYNC_READ_WAIT_TOKEN ||
+                         sd_req.state == SD_ASYNC_READ_DATA)) {
+        SD_Send_Command(SD_CMD12, 0);
     }
+
     SD_Deselect();
-    return RES_OK;
+
+    if (result == RES_OK) {
+        result = sd_req.result;
+    }
+    sd_req.result   = result;
+    sd_req.status   = (result == RES_OK) ? SD_REQUEST_DONE : SD_REQUEST_ERROR;
+    sd_req.state    = SD_ASYNC_IDLE;
+    sd_req.callback = NULL;
+
+    if (callback != NULL) {
+        callback(result);
+    }
 }
 
-bool SD_BusyWait() {
-    Timer2 = 500;
+static DRESULT SD_WaitAsync() {
+    while (SD_PollAsync() == SD_REQUEST_BUSY)
+        ;
+    return sd_req.result;
+}
+
+bool SD_BusyWait() { return SD_BusyWaitFor(500); }
+
+static bool SD_BusyWaitFor(uint32_t timeout_ms) {
+    Timer2 = timeout_ms;
     uint8_t res, dummy = 0xFF;
     do {
         SD_SPI_SendReceive(dummy, &res);
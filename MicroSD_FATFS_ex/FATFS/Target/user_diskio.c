@@ -39,6 +39,7 @@
 #include <string.h>
 #include "ff.h"      /* PARTITION 타입 정의 */
 #include "ffconf.h"  /* FF_VOLUMES 값 참조 */
+#include "sd_cache.h"
 
 /* Private typedef -----------------------------------------------------------*/
 /* Private define ------------------------------------------------------------*/
@@ -81,6 +82,7 @@ DSTATUS
 USER_initialize(BYTE pdrv /* Physical drive nmuber to identify the drive */
 ) {
     /* USER CODE BEGIN INIT */
+    SD_Cache_Init();
     return SD_Initialize(pdrv);
     /* USER CODE END INIT */
 }
@@ -111,7 +113,7 @@ DRESULT USER_read(BYTE  pdrv, /* Physical drive nmuber to identify the drive */
                   UINT  count   /* Number of sectors to read */
 ) {
     /* USER CODE BEGIN READ */
-    return SD_Read(pdrv, buff, sector, count);
+    return SD_Cache_Read(pdrv, buff, sector, count);
     /* USER CODE END READ */
 }
 
@@ -131,7 +133,7 @@ DRESULT USER_write(BYTE pdrv, /* Physical drive nmuber to identify the drive */
 ) {
     /* USER CODE BEGIN WRITE */
     /* USER CODE HERE */
-    return SD_Write(pdrv, buff, sector, count);
+    return SD_Cache_Write(pdrv, buff, sector, count);
     /* USER CODE END WRITE */
 }
 #endif /* _USE_WRITE == 1 */
@@ -149,7 +151,7 @@ DRESULT USER_ioctl(BYTE  pdrv, /* Physical drive nmuber (0..) */
                    void *buff  /* Buffer to send/receive control data */
 ) {
     /* USER CODE BEGIN IOCTL */
-    return SD_ioctl(pdrv, cmd, buff);
+    return SD_Cache_ioctl(pdrv, cmd, buff);
     /* USER CODE END IOCTL */
 }
 #endif /* _USE_IOCTL == 1 */
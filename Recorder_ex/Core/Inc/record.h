@@ -2,38 +2,107 @@
 #define _RECORD_H_
 
 #include "stm32f4xx.h"
+#include "record_dsp.h"
 
 // ==== 디버그/가공 토글 ====
 // 1: 가공 거의 없이 ADC-(2048)만 하고 <<4 하여 송출(가장 안전, 음성확인용)
-// 0: 50Hz HPF + 보수적 스케일 + 소프트 리미팅(음질 개선용)
+// 0: 50Hz HPF + 보수적 스케일 + 소프트 리미팅(음질 개선용, record_dsp.c)
+// PC 빌드(host/)에선 -DRAW_MODE=n, -DUART_ADPCM=n으로 바꾼다
+#ifndef RAW_MODE
 #define RAW_MODE 1
+#endif
 
 #define FS 44096
-#define OSR 1
+// OSR(오버샘플링 배수 1/2/4/8)은 record_dsp.h에서 고른다
 #define FRAME_NSAMP 256  // 전송 단위(파이썬도 256 가정)
 #define UART_BAUD 921600
 
+#define BUF_LEN (FRAME_NSAMP*OSR*2)      // DMA 이중버퍼 총 길이
+
+// ==== 샘플 클럭(TIM2 TRGO = OSR×FS) ====
+// TIM2 클럭 = APB1 45 MHz ×2. OSR 1이면 2040(CubeMX 값 그대로)
+#define TIM2_CLK_HZ 90000000
+#define REC_TIM2_PERIOD ((TIM2_CLK_HZ + OSR * FS / 2) / (OSR * FS) - 1)
+// ADCCLK 22.5 MHz, 변환 = 샘플링 + 12 사이클이 OSR×FS 주기 안에 끝나야 함
+#if OSR <= 2
+#define REC_ADC_SAMPLETIME ADC_SAMPLETIME_144CYCLES  // 6.9 us → ~144 kHz
+#elif OSR == 4
+#define REC_ADC_SAMPLETIME ADC_SAMPLETIME_84CYCLES   // 4.3 us → ~234 kHz
+#else
+#define REC_ADC_SAMPLETIME ADC_SAMPLETIME_28CYCLES   // 1.8 us → ~562 kHz
+#endif
+
+// ==== 프레임(v2) ====
+// [0x55 0xAA 타입 '2' N(LE16) seq(LE16) 타임스탬프(LE32)] + 페이로드 + CRC(LE32)
+//  - 타입 'S': PCM N개(LE16)
+//  - 타입 'A': [예측값(LE16) 스텝인덱스(1) 0(1)] + IMA-ADPCM N/2바이트
+//    (하위 니블이 앞 샘플). 헤더는 이 블록을 인코딩하기 직전의 상태라서
+//    프레임 하나만 받아도 디코딩된다.
+//  - seq: ADC 블록 번호(하위 16비트), 타임스탬프: 블록 첫 샘플의 번호(FS 기준)
+//    어떤 이유로든 블록이 빠지면(처리 지연, TX 버퍼 부족, UART 손실) 호스트가
+//    틈을 보고 같은 길이의 무음으로 채운다.
+//  - CRC: N부터 페이로드 끝까지를 CRC 주변장치(CRC-32/MPEG-2, 워드 단위)로
+//    계산. F4의 CRC는 다항식이 고정이라 CRC-16 대신 32비트를 그대로 보낸다.
+// PCM 모드는 헤더 바로 뒤에 PCM이 오도록 한 버퍼에 두고, process_block_to_pcm이
+// PCM 자리에 직접 쓴다(복사 없음). 버퍼는 2개라서 블록 N이 나가는 동안 블록
+// N+1을 처리한다.
+// 1: IMA-ADPCM(4:1) 'A', 0: PCM16 'S'
+#ifndef UART_ADPCM
+#define UART_ADPCM 0
+#endif
+
+#define FRAME_VERSION '2'
+#define FRAME_HDR_BYTES 12
+#define FRAME_CRC_BYTES 4
+#define FRAME_CRC_OFFSET 4  // CRC는 N부터(sync/타입/버전 제외)
+#if UART_ADPCM
+#define ADPCM_HDR_BYTES 4
+#define FRAME_PAYLOAD_BYTES (ADPCM_HDR_BYTES + FRAME_NSAMP / 2)
+#else
+#define FRAME_PAYLOAD_BYTES (FRAME_NSAMP * 2)
+#endif
+#define FRAME_BYTES (FRAME_HDR_BYTES + FRAME_PAYLOAD_BYTES + FRAME_CRC_BYTES)
+#if (FRAME_HDR_BYTES - FRAME_CRC_OFFSET + FRAME_PAYLOAD_BYTES) % 4
+#error "CRC 주변장치는 32비트 워드 단위입니다. FRAME_NSAMP를 8의 배수로 맞추세요."
+#endif
+
 // ==== 전송 예산(필수) ====
-// 8N1에서 바이트당 10비트 사용, 샘플당 2바이트
+// 8N1에서 바이트당 10비트 사용, 초당 FS/FRAME_NSAMP 프레임(헤더 포함)
+// PCM16이면 FS ≈ 44.7 kHz가 한계, ADPCM이면 약 3.6배 여유
 #define UART_BITS_PER_BYTE 10
-#define BYTES_PER_SAMPLE 2
-#if (FS * BYTES_PER_SAMPLE * UART_BITS_PER_BYTE) > UART_BAUD
+#if ((FS / FRAME_NSAMP + 1) * FRAME_BYTES * UART_BITS_PER_BYTE) > UART_BAUD
 #error "UART_BAUD가 FS에 비해 낮습니다. FS를 낮추거나 UART_BAUD를 올리세요."
 #endif
-#define BUF_LEN (FRAME_NSAMP*OSR*2)      // DMA 이중버퍼 총 길이
+
+// 1: USART2 TX DMA로 전송, 0: 블로킹 HAL_UART_Transmit(비교용)
+#define UART_USE_DMA 1
 
 extern UART_HandleTypeDef huart2;
+extern CRC_HandleTypeDef hcrc;
 
 static uint16_t adc_buf[BUF_LEN];
 
-// 상태(HPF용)
-static float hpf_y = 0.0f;
-static float x_prev = 0.0f;
+// ==== CPU 사용률(DWT 사이클) ====
+typedef struct {
+  uint32_t frames;         // 전송 요청한 프레임
+  uint32_t overruns;       // 두 버퍼가 모두 전송 중이라 버린 블록
+  uint32_t busy_cycles;    // 마지막 블록의 처리+전송 요청 시간
+  uint32_t period_cycles;  // 마지막 블록과 그 전 블록 사이 간격
+  uint16_t duty_permille;  // busy / period(‰), 8블록 평균
+  uint32_t dsp_cycles;     // 마지막 블록의 데시메이션+가공 사이클, ÷FRAME_NSAMP = 샘플당
+} rec_stats_t;
 
-// UART 전송 버퍼
-static uint8_t tx_buf[6 + FRAME_NSAMP * 2];
+extern volatile rec_stats_t rec_stats;
 
 uint16_t process_block_to_pcm(int16_t* out, const uint16_t* in,uint16_t N);
-void uart_send_frame(const int16_t* pcm, uint16_t N);
+
+int16_t* uart_frame_begin(uint32_t block);
+void uart_frame_commit(uint16_t N);
+void uart_tx_cplt_callback(void);
+uint32_t rec_adc_block_done(void);
+
+void rec_stats_init(void);
+void rec_block_begin(void);
+void rec_block_end(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef _RECORD_DSP_H_
+#define _RECORD_DSP_H_
+
+#include <stdint.h>
+
+// ==== 오버샘플링(1/2/4/8) ====
+// ADC를 OSR×FS로 돌리고 FIR 데시메이터(32·OSR탭)로 FS까지 내린다. 대역 내
+// 잡음이 1/OSR로 줄어 ENOB가 약 0.5·log2(OSR) 비트 오른다(잡음이 백색일 때).
+// 응답(OSR 2/4/8): 18 kHz까지 ±0.01 dB, 20 kHz -1.9 dB, 21 kHz -6 dB,
+// FS/2(22.05 kHz) -14.5 dB, 24 kHz -60.7/-62.4/-59.0 dB, 24.1 kHz 이상
+// -63.8 dB 이하. 전이 대역이 FS/2를 넘으므로 22~24 kHz 성분은 덜 줄어든 채
+// 20~22 kHz로 접혀 들어온다(통과 대역 18 kHz 밖). PC 빌드에선 -DOSR=n
+#ifndef OSR
+#define OSR 1
+#endif
+#if OSR != 1 && OSR != 2 && OSR != 4 && OSR != 8
+#error "OSR은 1, 2, 4, 8만 지원합니다."
+#endif
+
+// ==== RAW_MODE=0 가공 체인(고정소수점, 블록 단위) ====
+// Q15 → DC 차단 biquad(≈50 Hz) → 게인 → 소프트 리미터 → int16
+// Cortex-M4(__ARM_FEATURE_DSP)에서는 SMLAD/SSAT 명령을 쓰고, PC에서는 같은
+// 결과(비트 단위로 동일)를 내는 C 코드로 빌드된다. stm32 헤더는 필요 없다.
+
+// 게인(Q12, 4096 = ×1). Q15 변환에서 이미 ×16이므로 2048이면 RAW 모드의
+// ×8과 같은 크기 → 모드를 바꿔 들어도 음량이 같다. 최대 4.0(16384)
+#define DSP_GAIN_Q12 2048
+
+typedef struct {
+  uint32_t x12;    // x[n-1](하위 16비트) | x[n-2](상위 16비트), SMLAD용 패킹
+  int32_t y1, y2;  // biquad 출력 상태, Q30(1비트 여유)
+  int32_t gain;    // Q12
+} dsp_state_t;
+
+#define DSP_STATE_INIT(gain_q12) {0, 0, 0, (gain_q12)}
+
+// ADC 코드(0..4095) OSR·N개 → Q15 N개. 크기는 (in - 2048) << 4와 같고,
+// OSR > 1이면 데시메이션으로 12비트 아래 자리도 살아 있다.
+void dsp_adc_to_q15(int16_t* out, const uint16_t* in, uint16_t N);
+
+void dsp_init(dsp_state_t* s, int32_t gain_q12);
+// in은 Q15, out == in(제자리 처리) 가능
+void dsp_process_block(dsp_state_t* s, int16_t* out, const int16_t* in,
+                       uint16_t N);
+
+// ==== IMA-ADPCM 인코더(4:1) ====
+// 표준 IMA/DVI 알고리즘. 디코더(파이썬)는 같은 표로 복원한다.
+typedef struct {
+  int16_t predictor;  // 직전 복원 샘플
+  uint8_t index;      // 스텝 표 인덱스(0..88)
+} dsp_adpcm_t;
+
+// PCM N개(짝수) → N/2바이트, 하위 니블이 앞 샘플. s는 블록 끝 상태로 갱신
+void dsp_adpcm_encode(dsp_adpcm_t* s, uint8_t* out, const int16_t* in,
+                      uint16_t N);
+
+#endif
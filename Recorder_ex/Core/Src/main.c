@@ -45,12 +45,16 @@
 ADC_HandleTypeDef hadc1;
 DMA_HandleTypeDef hdma_adc1;
 
+CRC_HandleTypeDef hcrc;
+
 TIM_HandleTypeDef htim2;
 
 UART_HandleTypeDef huart2;
+DMA_HandleTypeDef hdma_usart2_tx;
 
 /* USER CODE BEGIN PV */
 static volatile uint8_t half_ready = 0, full_ready = 0;
+static volatile uint32_t half_block, full_block;  // 콜백 시점의 ADC 블록 번호
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -60,13 +64,23 @@ static void MX_DMA_Init(void);
 static void MX_ADC1_Init(void);
 static void MX_USART2_UART_Init(void);
 static void MX_TIM2_Init(void);
+static void MX_CRC_Init(void);
 /* USER CODE BEGIN PFP */
 
 void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef* hadc) {
-  if (hadc->Instance == ADC1) half_ready = 1;
+  if (hadc->Instance == ADC1) {
+    half_block = rec_adc_block_done();
+    half_ready = 1;
+  }
 }
 void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef* hadc) {
-  if (hadc->Instance == ADC1) full_ready = 1;
+  if (hadc->Instance == ADC1) {
+    full_block = rec_adc_block_done();
+    full_ready = 1;
+  }
+}
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef* huart) {
+  if (huart->Instance == USART2) uart_tx_cplt_callback();
 }
 
 /* USER CODE END PFP */
@@ -109,15 +123,15 @@ int main(void)
   MX_ADC1_Init();
   MX_USART2_UART_Init();
   MX_TIM2_Init();
+  MX_CRC_Init();
   /* USER CODE BEGIN 2 */
+  rec_stats_init();
   HAL_ADC_Start_DMA(&hadc1, (uint32_t*)adc_buf, BUF_LEN);
   HAL_TIM_Base_Start(&htim2);
   /* USER CODE END 2 */
 
   /* Infinite loop */
   /* USER CODE BEGIN WHILE */
-  int16_t pcm_frame[FRAME_NSAMP];
-
   while (1) {
     /* USER CODE END WHILE */
 
@@ -126,19 +140,27 @@ int main(void)
     if (half_ready) {
       half_ready = 0;
 
-      const uint16_t* src = &adc_buf[0];  // 하프버퍼 #0 (0..255)
-      int16_t pcm_frame[FRAME_NSAMP];
-      uint16_t produced = process_block_to_pcm(pcm_frame, src, FRAME_NSAMP);
-      uart_send_frame(pcm_frame, produced);  // 딱 1프레임만 전송
+      rec_block_begin();
+      const uint16_t* src = &adc_buf[0];  // 하프버퍼 #0 (OSR·256개)
+      int16_t* pcm = uart_frame_begin(half_block);  // 전송 버퍼의 PCM 자리
+      if (pcm) {
+        uint16_t produced = process_block_to_pcm(pcm, src, FRAME_NSAMP);
+        uart_frame_commit(produced);  // 딱 1프레임만 전송
+      }
+      rec_block_end();
     }
 
     if (full_ready) {
       full_ready = 0;
 
-      const uint16_t* src = &adc_buf[BUF_LEN / 2];  // 하프버퍼 #1 (256..511)
-      int16_t pcm_frame[FRAME_NSAMP];
-      uint16_t produced = process_block_to_pcm(pcm_frame, src, FRAME_NSAMP);
-      uart_send_frame(pcm_frame, produced);  // 딱 1프레임만 전송
+      rec_block_begin();
+      const uint16_t* src = &adc_buf[BUF_LEN / 2];  // 하프버퍼 #1
+      int16_t* pcm = uart_frame_begin(full_block);
+      if (pcm) {
+        uint16_t produced = process_block_to_pcm(pcm, src, FRAME_NSAMP);
+        uart_frame_commit(produced);
+      }
+      rec_block_end();
     }
   }
   /* USER CODE END 3 */
@@ -245,11 +267,43 @@ static void MX_ADC1_Init(void)
     Error_Handler();
   }
   /* USER CODE BEGIN ADC1_Init 2 */
+  // OSR×FS에서도 변환이 트리거 주기 안에 끝나도록 샘플링 시간을 줄인다
+  sConfig.SamplingTime = REC_ADC_SAMPLETIME;
+  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
 
   /* USER CODE END ADC1_Init 2 */
 
 }
 
+/**
+  * @brief CRC Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_CRC_Init(void)
+{
+
+  /* USER CODE BEGIN CRC_Init 0 */
+
+  /* USER CODE END CRC_Init 0 */
+
+  /* USER CODE BEGIN CRC_Init 1 */
+
+  /* USER CODE END CRC_Init 1 */
+  hcrc.Instance = CRC;
+  if (HAL_CRC_Init(&hcrc) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /* USER CODE BEGIN CRC_Init 2 */
+
+  /* USER CODE END CRC_Init 2 */
+
+}
+
 /**
   * @brief TIM2 Initialization Function
   * @param None
@@ -290,6 +344,9 @@ static void MX_TIM2_Init(void)
     Error_Handler();
   }
   /* USER CODE BEGIN TIM2_Init 2 */
+  // TRGO = OSR×FS (OSR 1이면 CubeMX 값 2040과 같음)
+  __HAL_TIM_SET_AUTORELOAD(&htim2, REC_TIM2_PERIOD);
+  htim2.Instance->EGR = TIM_EGR_UG;  // ARR 프리로드를 바로 반영
 
   /* USER CODE END TIM2_Init 2 */
 
@@ -335,9 +392,13 @@ static void MX_DMA_Init(void)
 {
 
   /* DMA controller clock enable */
+  __HAL_RCC_DMA1_CLK_ENABLE();
   __HAL_RCC_DMA2_CLK_ENABLE();
 
   /* DMA interrupt init */
+  /* DMA1_Stream6_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Stream6_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Stream6_IRQn);
   /* DMA2_Stream0_IRQn interrupt configuration */
   HAL_NVIC_SetPriority(DMA2_Stream0_IRQn, 0, 0);
   HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
@@ -1,40 +1,184 @@
 #include "record.h"
 
 // ====== 가공 최소화 버전 (RAW_MODE=1) ======
-//  - (in - 2048) << 4 만 적용 → WAV로 바로 들으면 “그냥 마이크 소리”가 나와야
+//  - (in - 2048) << 3 만 적용 → WAV로 바로 들으면 “그냥 마이크 소리”가 나와야
 //  정상
 //  - 여기서도 이상하면 아날로그/샘플링/전송 문제임(가공 때문 아님).
 // ====== 음질 개선 버전 (RAW_MODE=0) ======
-//  - 1차 HPF(fc≈50 Hz, Fs=12kHz) + 보수 스케일 ×4 + 소프트 리미터(부드러운
-//  무릎)
+//  - DC 차단 biquad(fc≈50 Hz) + 게인(RAW의 ×8과 같은 크기) + 소프트 리미터
+//    (-6 dBFS 무릎), Q15/Q30 고정소수점 → record_dsp.c
+#if !RAW_MODE
+static dsp_state_t dsp = DSP_STATE_INIT(DSP_GAIN_Q12);
+#endif
+
 uint16_t process_block_to_pcm(int16_t* out, const uint16_t* in,
                                      uint16_t N) {
+  uint32_t t0 = DWT->CYCCNT;
+
+  // ADC OSR·N개 → Q15 N개(OSR > 1이면 FIR 데시메이션)
+  dsp_adc_to_q15(out, in, N);
+#if RAW_MODE
   // ---- RAW 모드: 목소리 확인 최우선 ----
-  // 12-bit(0..4095) → mid 제거 → 16-bit로 확장(<<4 ≒ ×16)하면 다소 큼 → ×8
-  // 수준으로 맞춤 지터 없이 듣고자 살짝 낮춰서 ×8 사용
+  // Q15(×16)는 다소 큼 → ×8 수준으로 맞춤 지터 없이 듣고자 살짝 낮춰서 ×8 사용
+  // OSR 1이면 (in - 2048) << 3과 같다
   for (uint16_t i = 0; i < N; i++) {
-    int32_t dc_removed = (int32_t)in[i] - 2048;  // 중심 제거
-    int32_t v = dc_removed << 3;  // ×8 (필요시 2~4로 더 낮춰도 됨)
-    if (v > 32767) v = 32767;
-    if (v < -32768) v = -32768;
-    out[i] = (int16_t)v;
+    out[i] = (int16_t)(out[i] >> 1);
   }
+#else
+  dsp_process_block(&dsp, out, out, N);
+#endif
+  rec_stats.dsp_cycles = DWT->CYCCNT - t0;
   return N;
 }
 
-void uart_send_frame(const int16_t* pcm, uint16_t N) {
-  tx_buf[0] = 0x55;
-  tx_buf[1] = 0xAA;
-  tx_buf[2] = 'S';
-  tx_buf[3] = '1';
-  tx_buf[4] = (uint8_t)(N & 0xFF);
-  tx_buf[5] = (uint8_t)(N >> 8);
+// ====== 프레임 전송 ======
+// PCM(int16)이 2바이트 정렬되도록 uint16_t로 잡는다. 헤더가 12바이트라 PCM은
+// 6번째 워드부터 시작한다. Cortex-M은 리틀엔디언이라 그대로 LE16이 된다.
+// CRC 주변장치에 워드로 넣기 위해 4바이트 정렬
+static uint16_t tx_frames[2][FRAME_BYTES / 2] __attribute__((aligned(4)));
+static volatile uint8_t tx_busy;      // bit n: tx_frames[n] 전송 중 또는 대기
+static volatile int8_t tx_active = -1;   // DMA가 보내는 중인 버퍼
+static volatile int8_t tx_pending = -1;  // 앞 프레임이 끝나면 보낼 버퍼
+static volatile uint16_t tx_len[2];
+static uint8_t fill_slot;
+static uint32_t adc_blocks;           // ADC 하프버퍼 완료 횟수(ISR에서만 씀)
+static uint32_t fill_block;           // 채우는 중인 프레임의 블록 번호
+#if UART_ADPCM
+// ADPCM은 PCM을 여기서 받아 commit 때 프레임 버퍼로 인코딩한다
+static int16_t pcm_work[FRAME_NSAMP];
+static dsp_adpcm_t adpcm;
+#endif
 
-  uint8_t* p = &tx_buf[6];
-  for (uint16_t i = 0; i < N; i++) {
-    int16_t s = pcm[i];
-    *p++ = (uint8_t)(s & 0xFF);
-    *p++ = (uint8_t)((s >> 8) & 0xFF);
+volatile rec_stats_t rec_stats;
+static uint32_t block_start;
+
+static void uart_frame_start(int8_t slot) {
+  tx_active = slot;
+  if (HAL_UART_Transmit_DMA(&huart2, (uint8_t*)tx_frames[slot], tx_len[slot]) !=
+      HAL_OK) {
+    // 시작 실패 → 버리고 다음 프레임부터 다시
+    tx_busy &= ~(1 << slot);
+    tx_active = -1;
+  }
+}
+
+// 다음 프레임의 PCM 자리. 두 버퍼가 다 쓰이는 중이면 NULL(블록 버림)
+// block: 그 하프버퍼의 콜백이 rec_adc_block_done에서 받은 번호. 두 하프가 함께
+// 밀려 있어도 각자 번호를 갖고, 버려도 번호는 지나가므로 호스트가 틈을 안다
+int16_t* uart_frame_begin(uint32_t block) {
+  fill_block = block;
+  if (tx_busy & (1 << fill_slot)) {
+    rec_stats.overruns++;
+    return NULL;
+  }
+#if UART_ADPCM
+  return pcm_work;
+#else
+  return (int16_t*)&tx_frames[fill_slot][FRAME_HDR_BYTES / 2];
+#endif
+}
+
+// 헤더를 채우고 전송. DMA가 다른 프레임을 보내는 중이면 끝난 뒤에 보낸다.
+void uart_frame_commit(uint16_t N) {
+  uint8_t* hdr = (uint8_t*)tx_frames[fill_slot];
+  int8_t slot = fill_slot;
+  uint32_t ts = fill_block * FRAME_NSAMP;
+  uint16_t payload;
+  uint32_t crc;
+
+  hdr[0] = 0x55;
+  hdr[1] = 0xAA;
+#if UART_ADPCM
+  uint8_t* p = &hdr[FRAME_HDR_BYTES];
+
+  // 인코딩 전 상태를 먼저 적는다(호스트는 이 값부터 복원)
+  hdr[2] = 'A';
+  p[0] = (uint8_t)(adpcm.predictor & 0xFF);
+  p[1] = (uint8_t)((adpcm.predictor >> 8) & 0xFF);
+  p[2] = adpcm.index;
+  p[3] = 0;
+  dsp_adpcm_encode(&adpcm, &p[ADPCM_HDR_BYTES], pcm_work, N);
+  payload = ADPCM_HDR_BYTES + N / 2;
+#else
+  hdr[2] = 'S';
+  payload = 2 * N;
+#endif
+  hdr[3] = FRAME_VERSION;
+  hdr[4] = (uint8_t)(N & 0xFF);
+  hdr[5] = (uint8_t)(N >> 8);
+  hdr[6] = (uint8_t)(fill_block & 0xFF);
+  hdr[7] = (uint8_t)((fill_block >> 8) & 0xFF);
+  hdr[8] = (uint8_t)(ts & 0xFF);
+  hdr[9] = (uint8_t)((ts >> 8) & 0xFF);
+  hdr[10] = (uint8_t)((ts >> 16) & 0xFF);
+  hdr[11] = (uint8_t)((ts >> 24) & 0xFF);
+
+  // N..페이로드 끝을 워드 단위로. HAL_CRC_Calculate가 매번 초기값으로 리셋
+  crc = HAL_CRC_Calculate(&hcrc, (uint32_t*)&hdr[FRAME_CRC_OFFSET],
+                          (FRAME_HDR_BYTES - FRAME_CRC_OFFSET + payload) / 4);
+  uint8_t* c = &hdr[FRAME_HDR_BYTES + payload];
+  c[0] = (uint8_t)(crc & 0xFF);
+  c[1] = (uint8_t)((crc >> 8) & 0xFF);
+  c[2] = (uint8_t)((crc >> 16) & 0xFF);
+  c[3] = (uint8_t)((crc >> 24) & 0xFF);
+  tx_len[slot] = FRAME_HDR_BYTES + payload + FRAME_CRC_BYTES;
+  rec_stats.frames++;
+  fill_slot ^= 1;
+
+#if UART_USE_DMA
+  __disable_irq();
+  tx_busy |= 1 << slot;
+  if (tx_active < 0) {
+    __enable_irq();
+    uart_frame_start(slot);
+  } else {
+    tx_pending = slot;
+    __enable_irq();
   }
-  HAL_UART_Transmit(&huart2, tx_buf, 6 + 2 * N, HAL_MAX_DELAY);
+#else
+  HAL_UART_Transmit(&huart2, (uint8_t*)tx_frames[slot], tx_len[slot],
+                    HAL_MAX_DELAY);
+#endif
+}
+
+// HAL_UART_TxCpltCallback(USART2)에서 호출
+void uart_tx_cplt_callback(void) {
+  int8_t next = tx_pending;
+
+  if (tx_active >= 0) tx_busy &= ~(1 << tx_active);
+  tx_active = -1;
+  if (next >= 0) {
+    tx_pending = -1;
+    uart_frame_start(next);
+  }
+}
+
+// HAL_ADC_ConvHalfCpltCallback / ConvCpltCallback(ADC1)에서 호출. 방금 끝난
+// 하프버퍼의 블록 번호를 돌려주므로 콜백이 하프별로 저장해 둔다
+uint32_t rec_adc_block_done(void) { return adc_blocks++; }
+
+// ====== CPU 사용률 ======
+// 블록 처리 시작~끝(busy)과 블록 간격(period)을 DWT 사이클로 잰다.
+// UART_USE_DMA 0이면 busy에 전송 시간이 포함된다.
+void rec_stats_init(void) {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  block_start = DWT->CYCCNT;
+}
+
+void rec_block_begin(void) {
+  uint32_t now = DWT->CYCCNT;
+
+  rec_stats.period_cycles = now - block_start;
+  block_start = now;
+}
+
+void rec_block_end(void) {
+  uint32_t duty;
+
+  rec_stats.busy_cycles = DWT->CYCCNT - block_start;
+  if (rec_stats.period_cycles == 0) return;
+  duty = (uint64_t)rec_stats.busy_cycles * 1000 / rec_stats.period_cycles;
+  rec_stats.duty_permille = (rec_stats.duty_permille * 7 + duty) / 8;
 }
\ No newline at end of file
@@ -0,0 +1,293 @@
+#include "record_dsp.h"
+
+#include <string.h>
+
+#if defined(__ARM_FEATURE_DSP)
+#include "stm32f4xx.h"  // CMSIS __SMLAD / __SSAT
+#define DSP_SMLAD(x, y, acc) ((int32_t)__SMLAD((x), (y), (uint32_t)(acc)))
+#define DSP_SSAT(v, n) __SSAT((v), (n))
+#else
+// PC 빌드용: M4 명령과 같은 결과를 내는 C 구현
+static inline int32_t DSP_SMLAD(uint32_t x, uint32_t y, int32_t acc) {
+  return acc + (int16_t)x * (int16_t)y +
+         (int16_t)(x >> 16) * (int16_t)(y >> 16);
+}
+static inline int32_t dsp_ssat(int32_t v, int n) {
+  int32_t hi = (1 << (n - 1)) - 1;
+  if (v > hi) return hi;
+  if (v < -hi - 1) return -hi - 1;
+  return v;
+}
+#define DSP_SSAT(v, n) dsp_ssat((v), (n))
+#endif
+
+// ====== DC 차단 biquad ======
+// H(z) = g·(1 - z^-1)^2 / (1 - r·z^-1)^2, r = 127/128 (fc ≈ 55 Hz @ 44.1 kHz)
+//  - 영점 2개가 정확히 DC에 있고(b0+b1+b2 = 0), 극점은 중근이라 오버슈트 없음
+//  - r을 2의 거듭제곱 분모로 잡아 a1 = 2r, a2 = -r^2이 정확히 표현된다.
+//    (Butterworth 50 Hz 계수는 Q14에서 극점이 z=1로 붙어 DC가 안 막힌다)
+//  - g = ((1+r)/2)^2 → 나이퀴스트에서 이득 1
+//  b: Q14(16bit, SMLAD 패킹), a: Q30
+//  피드백 상태 y는 Q30으로 저장한다. 극점이 1에 가까워 y를 Q15로 자르면
+//  잘림 잡음이 크게 증폭되기 때문(Q30이면 1 LSB 아래로 묻힌다).
+#define BQ_B0 16256
+#define BQ_B1 (-32512)
+#define BQ_B2 16256
+#define BQ_B12 (((uint32_t)(uint16_t)BQ_B1) | ((uint32_t)(uint16_t)BQ_B2 << 16))
+#define BQ_A1 2130706432L    // 2r    = 1.984375   (Q30)
+#define BQ_A2 (-1057030144L) // -r^2  = -0.984436 (Q30)
+
+// ====== 소프트 무릎 리미터 ======
+// |v| ≤ KNEE(-6 dBFS)는 그대로, 그 위는 KNEE + (32767-KNEE)·tanh(d/(32767-KNEE))
+// d = |v| - KNEE를 1024 간격 표 + 선형 보간으로 계산(무릎에서 기울기 1로 이어짐)
+// 입력은 SSAT 18(±4배 풀스케일)로 제한되므로 d < 131072 → 표 129칸
+#define LIM_KNEE 16384
+#define LIM_SHIFT 10
+
+static const int16_t lim_lut[129] = {
+  16384, 17407, 18421, 19420, 20397, 21344, 22255, 23127,
+  23955, 24737, 25470, 26155, 26790, 27377, 27917, 28411,
+  28862, 29272, 29643, 29979, 30282, 30554, 30799, 31017,
+  31213, 31388, 31544, 31683, 31807, 31917, 32014, 32101,
+  32178, 32246, 32306, 32360, 32407, 32449, 32486, 32519,
+  32548, 32573, 32596, 32616, 32634, 32649, 32663, 32675,
+  32686, 32696, 32704, 32711, 32718, 32724, 32729, 32733,
+  32737, 32741, 32744, 32746, 32749, 32751, 32753, 32755,
+  32756, 32757, 32758, 32759, 32760, 32761, 32762, 32762,
+  32763, 32763, 32764, 32764, 32765, 32765, 32765, 32765,
+  32766, 32766, 32766, 32766, 32766, 32766, 32766, 32766,
+  32766, 32767, 32767, 32767, 32767, 32767, 32767, 32767,
+  32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767,
+  32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767,
+  32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767,
+  32767, 32767, 32767, 32767, 32767, 32767, 32767, 32767,
+  32767,
+};
+
+static inline int32_t soft_limit(int32_t v) {
+  int32_t a = v < 0 ? -v : v;
+
+  if (a > LIM_KNEE) {
+    uint32_t d = (uint32_t)(a - LIM_KNEE);
+    uint32_t i = d >> LIM_SHIFT;
+    int32_t f = (int32_t)(d & ((1u << LIM_SHIFT) - 1));
+    int32_t y0 = lim_lut[i];
+    a = y0 + (((lim_lut[i + 1] - y0) * f) >> LIM_SHIFT);
+  }
+  return v < 0 ? -a : a;
+}
+
+// ====== 데시메이터 ======
+// 1단 FIR(Kaiser β=7, fc 21 kHz, 계수 합 = 32768)을 OSR 샘플마다 한 번만
+// 계산한다(다상 분해와 같은 연산량). 블록 경계를 넘는 과거 DEC_TAPS개는
+// dec_line 앞쪽에 남겨 두고, 블록은 DEC_CHUNK 출력씩 잘라 처리한다.
+// ADC 코드는 0..4095라 int16으로 그대로 SMLAD에 넣고, 중심값(2048)은
+// 합이 32768인 걸 이용해 누산 뒤에 한 번에 뺀다.
+#if OSR > 1
+#define DEC_TAPS (32 * OSR)
+#define DEC_CHUNK 64
+
+#if OSR == 2
+static const int16_t dec_h[DEC_TAPS] __attribute__((aligned(4))) = {
+  0, 4, 1, -10, -5, 20, 13, -35, -30, 53,
+  59, -74, -106, 93, 175, -105, -272, 102, 404, -72,
+  -579, -1, 810, 145, -1125, -413, 1598, 942, -2479, -2304,
+  5396, 14179, 14179, 5396, -2304, -2479, 942, 1598, -413, -1125,
+  145, 810, -1, -579, -72, 404, 102, -272, -105, 175,
+  93, -106, -74, 59, 53, -30, -35, 13, 20, -5,
+  -10, 1, 4, 0,
+};
+#elif OSR == 4
+static const int16_t dec_h[DEC_TAPS] __attribute__((aligned(4))) = {
+  0, 1, 2, 2, 2, -1, -4, -6, -5, 1,
+  8, 13, 11, 1, -12, -22, -21, -7, 17, 36,
+  38, 17, -19, -53, -63, -37, 18, 73, 97, 67,
+  -9, -95, -142, -114, -13, 115, 198, 181, 53, -129,
+  -268, -275, -121, 131, 352, 407, 232, -112, -457, -600,
+  -416, 54, 597, 909, 749, 87, -828, -1533, -1530, -508,
+  1475, 3966, 6254, 7620, 7620, 6254, 3966, 1475, -508, -1530,
+  -1533, -828, 87, 749, 909, 597, 54, -416, -600, -457,
+  -112, 232, 407, 352, 131, -121, -275, -268, -129, 53,
+  181, 198, 115, -13, -114, -142, -95, -9, 67, 97,
+  73, 18, -37, -63, -53, -19, 17, 38, 36, 17,
+  -7, -21, -22, -12, 1, 11, 13, 8, 1, -5,
+  -6, -4, -1, 2, 2, 2, 1, 0,
+};
+#elif OSR == 8
+static const int16_t dec_h[DEC_TAPS] __attribute__((aligned(4))) = {
+  0, 0, 0, 0, 1, 1, 1, 1, 1, 1,
+  0, -1, -2, -3, -3, -3, -3, -2, -1, 1,
+  3, 5, 6, 7, 6, 5, 2, -1, -5, -8,
+  -11, -12, -12, -10, -6, -1, 5, 11, 16, 20,
+  20, 18, 13, 5, -5, -15, -23, -30, -32, -30,
+  -24, -13, 1, 17, 31, 42, 48, 48, 40, 26,
+  7, -16, -38, -56, -69, -72, -65, -47, -22, 10,
+  42, 72, 93, 103, 99, 79, 47, 5, -42, -86,
+  -122, -143, -145, -126, -87, -32, 33, 98, 154, 193,
+  208, 193, 149, 79, -9, -103, -191, -260, -296, -293,
+  -247, -160, -40, 97, 236, 354, 434, 460, 420, 313,
+  145, -67, -299, -523, -703, -808, -810, -687, -432, -46,
+  454, 1038, 1666, 2294, 2871, 3353, 3698, 3883, 3883, 3698,
+  3353, 2871, 2294, 1666, 1038, 454, -46, -432, -687, -810,
+  -808, -703, -523, -299, -67, 145, 313, 420, 460, 434,
+  354, 236, 97, -40, -160, -247, -293, -296, -260, -191,
+  -103, -9, 79, 149, 193, 208, 193, 154, 98, 33,
+  -32, -87, -126, -145, -143, -122, -86, -42, 5, 47,
+  79, 99, 103, 93, 72, 42, 10, -22, -47, -65,
+  -72, -69, -56, -38, -16, 7, 26, 40, 48, 48,
+  42, 31, 17, 1, -13, -24, -30, -32, -30, -23,
+  -15, -5, 5, 13, 18, 20, 20, 16, 11, 5,
+  -1, -6, -10, -12, -12, -11, -8, -5, -1, 2,
+  5, 6, 7, 6, 5, 3, 1, -1, -2, -3,
+  -3, -3, -3, -2, -1, 0, 1, 1, 1, 1,
+  1, 1, 0, 0, 0, 0,
+};
+#endif
+
+// 과거 샘플은 중심값(무음)으로 시작한다. 0으로 두면 첫 DEC_TAPS/OSR개 출력이
+// -풀스케일에서 올라오는 팝이 된다. 뒤쪽은 매 블록 memcpy로 채워진다.
+static int16_t dec_line[DEC_TAPS + DEC_CHUNK * OSR] __attribute__((aligned(4))) = {
+  [0 ... DEC_TAPS - 1] = 2048,
+};
+
+static inline uint32_t rd_q15x2(const int16_t* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));  // 4바이트 정렬이라 LDR 한 번
+  return v;
+}
+
+void dsp_adc_to_q15(int16_t* out, const uint16_t* in, uint16_t N) {
+  while (N) {
+    uint16_t n = N < DEC_CHUNK ? N : DEC_CHUNK;
+
+    memcpy(&dec_line[DEC_TAPS], in, n * OSR * sizeof(int16_t));
+    for (uint16_t k = 0; k < n; k++) {
+      // 출력 k의 창: 가장 최근 샘플이 (k+1)·OSR번째 입력
+      const int16_t* w = &dec_line[(k + 1) * OSR];
+      int32_t acc = 0;
+
+      for (uint16_t j = 0; j < DEC_TAPS; j += 4) {
+        acc = DSP_SMLAD(rd_q15x2(&w[j]), rd_q15x2(&dec_h[j]), acc);
+        acc = DSP_SMLAD(rd_q15x2(&w[j + 2]), rd_q15x2(&dec_h[j + 2]), acc);
+      }
+      // Σh·code(Q15) - 2048·32768 → ×16/32768 = >>11 (반올림)
+      out[k] = (int16_t)DSP_SSAT((acc - (2048 << 15) + (1 << 10)) >> 11, 16);
+    }
+    memmove(dec_line, &dec_line[n * OSR], DEC_TAPS * sizeof(int16_t));
+
+    in += n * OSR;
+    out += n;
+    N -= n;
+  }
+}
+#else
+void dsp_adc_to_q15(int16_t* out, const uint16_t* in, uint16_t N) {
+  for (uint16_t i = 0; i < N; i++) {
+    out[i] = (int16_t)(((int32_t)in[i] - 2048) << 4);
+  }
+}
+#endif
+
+void dsp_init(dsp_state_t* s, int32_t gain_q12) {
+  s->x12 = 0;
+  s->y1 = 0;
+  s->y2 = 0;
+  s->gain = gain_q12;
+}
+
+void dsp_process_block(dsp_state_t* s, int16_t* out, const int16_t* in,
+                       uint16_t N) {
+  uint32_t x12 = s->x12;
+  int32_t y1 = s->y1, y2 = s->y2;
+  int32_t gain = s->gain;
+
+  for (uint16_t i = 0; i < N; i++) {
+    int32_t x0 = in[i];  // Q15
+
+    // b0·x0 + b1·x1 + b2·x2 (Q29). |합| ≤ 32768·65024 < 2^31
+    int32_t ff = DSP_SMLAD(x12, BQ_B12, x0 * BQ_B0);
+    // Q60 누산 → Q30 (M4에서 SMLAL 두 번)
+    int64_t acc = ((int64_t)ff << 31) + (int64_t)BQ_A1 * y1 +
+                  (int64_t)BQ_A2 * y2;
+    int64_t y = acc >> 30;
+    if (y > INT32_MAX) y = INT32_MAX;
+    if (y < INT32_MIN) y = INT32_MIN;
+
+    y2 = y1;
+    y1 = (int32_t)y;
+    x12 = (x12 << 16) | (uint16_t)x0;
+
+    // Q30 → Q15(±2배까지) × 게인(Q12) → ±4배 풀스케일로 자르고 리미터
+    int32_t v = ((y1 >> 15) * gain) >> 12;
+    v = DSP_SSAT(v, 18);
+    out[i] = (int16_t)DSP_SSAT(soft_limit(v), 16);
+  }
+
+  s->x12 = x12;
+  s->y1 = y1;
+  s->y2 = y2;
+}
+
+// ====== IMA-ADPCM ======
+static const int16_t ima_step[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+  19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+  130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+  337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+  876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+  2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+  5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+  15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+};
+
+static const int8_t ima_index[8] = {-1, -1, -1, -1, 2, 4, 6, 8};
+
+void dsp_adpcm_encode(dsp_adpcm_t* s, uint8_t* out, const int16_t* in,
+                      uint16_t N) {
+  int32_t pred = s->predictor;
+  int32_t idx = s->index;
+
+  for (uint16_t i = 0; i < N; i++) {
+    int32_t step = ima_step[idx];
+    int32_t diff = in[i] - pred;
+    int32_t vpdiff = step >> 3;
+    uint8_t code = 0;
+
+    if (diff < 0) {
+      code = 8;
+      diff = -diff;
+    }
+    // 연속 근사: 디코더의 vpdiff 계산과 같은 순서
+    if (diff >= step) {
+      code |= 4;
+      diff -= step;
+      vpdiff += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+      code |= 2;
+      diff -= step;
+      vpdiff += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+      code |= 1;
+      vpdiff += step;
+    }
+
+    pred += (code & 8) ? -vpdiff : vpdiff;
+    pred = DSP_SSAT(pred, 16);
+    idx += ima_index[code & 7];
+    if (idx < 0) idx = 0;
+    if (idx > 88) idx = 88;
+
+    if (i & 1)
+      out[i >> 1] |= (uint8_t)(code << 4);
+    else
+      out[i >> 1] = code;
+  }
+
+  s->predictor = (int16_t)pred;
+  s->index = (uint8_t)idx;
+}
@@ -0,0 +1,119 @@
+// 데시메이터 주파수 응답을 펌웨어 코드 그대로 잰다(dsp_adc_to_q15에 사인을
+// 넣고 출력에서 해당(접힌) 주파수 성분을 최소자승으로 맞춤). record_dsp.h의
+// 응답 주석이 이 값이고, 벗어나면 실패로 끝난다. 처음 블록이 무음(2048)일 때
+// 출력이 0인지도 본다(히스토리 초기값).
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "record_dsp.h"
+
+#define FS 44096.0
+#define BLOCK 256
+#define NOUT (BLOCK * 64)
+#define SKIP (BLOCK * 2)   // 데시메이터 과도 구간
+#define AMP 2000.0         // ADC 코드, 클리핑 없이 거의 풀스케일
+#define STEP 250.0
+
+static uint16_t in[NOUT * OSR];
+static int16_t out[NOUT];
+
+// a·cos + b·sin + c 최소자승(3×3 가우스 소거), 진폭 hypot(a, b)를 돌려준다
+static double fit(const int16_t* x, int n, double f) {
+  double w = 2 * M_PI * f / FS;
+  double m[3][4] = {{0}};
+
+  for (int i = 0; i < n; i++) {
+    double b[3] = {cos(w * i), sin(w * i), 1};
+
+    for (int r = 0; r < 3; r++) {
+      for (int c = 0; c < 3; c++) m[r][c] += b[r] * b[c];
+      m[r][3] += b[r] * x[i];
+    }
+  }
+  for (int c = 0; c < 3; c++) {
+    int p = c;
+
+    for (int r = c + 1; r < 3; r++) {
+      if (fabs(m[r][c]) > fabs(m[p][c])) p = r;
+    }
+    for (int k = 0; k < 4; k++) {
+      double t = m[c][k];
+      m[c][k] = m[p][k];
+      m[p][k] = t;
+    }
+    for (int r = 0; r < 3; r++) {
+      if (r == c) continue;
+      double g = m[r][c] / m[c][c];
+      for (int k = c; k < 4; k++) m[r][k] -= g * m[c][k];
+    }
+  }
+  return hypot(m[0][3] / m[0][0], m[1][3] / m[1][1]);
+}
+
+// f(입력 주파수, OSR·FS 기준) → 출력에서 보이는 주파수와 이득(dB)
+static double response(double f, double* fa) {
+  for (int i = 0; i < NOUT * OSR; i++) {
+    in[i] = (uint16_t)lround(2048 + AMP * sin(2 * M_PI * f * i / (FS * OSR)));
+  }
+  for (int i = 0; i < NOUT; i += BLOCK) {
+    dsp_adc_to_q15(&out[i], &in[i * OSR], BLOCK);
+  }
+  *fa = fmod(f, FS);
+  if (*fa > FS / 2) *fa = FS - *fa;
+  return 20 * log10(fit(&out[SKIP], NOUT - SKIP, *fa) / (AMP * 16));
+}
+
+static int check(const char* what, double f, double db, double lo, double hi) {
+  int ok = db >= lo && db <= hi;
+
+  printf("  %-10s %7.0f Hz %8.3f dB  [%g, %g]%s\n", what, f, db, lo, hi,
+         ok ? "" : "  FAIL");
+  return ok;
+}
+
+int main(void) {
+  // record_dsp.h 주석의 24 kHz 값
+  const double at24 = OSR == 2 ? -60.7 : OSR == 4 ? -62.4 : -59.0;
+  double fa, db, worst = 0, worst_f = 0;
+  int ok = 1;
+
+  printf("OSR %d:\n", OSR);
+
+  // 무음으로 시작하면 첫 블록도 0이어야 한다(팝 없음)
+  for (int i = 0; i < BLOCK * OSR; i++) in[i] = 2048;
+  dsp_adc_to_q15(out, in, BLOCK);
+  for (int i = 0; i < BLOCK; i++) {
+    if (out[i] != 0) {
+      printf("  mid-scale start: out[%d] = %d  FAIL\n", i, out[i]);
+      ok = 0;
+      break;
+    }
+  }
+
+  if (OSR == 1) {  // 필터 없음, ×16만
+    ok &= check("pass", 1000, response(1000, &fa), -0.01, 0.01);
+    return !ok;
+  }
+
+  for (double f = 0; f <= 18000; f += 1000) {
+    db = response(f ? f : 100, &fa);
+    if (fabs(db) > fabs(worst)) worst = db, worst_f = f;
+  }
+  ok &= check("pass", worst_f, worst, -0.01, 0.01);
+  ok &= check("20 kHz", 20000, response(20000, &fa), -2.0, -1.8);
+  ok &= check("21 kHz", 21000, response(21000, &fa), -6.1, -5.9);
+  // FS/2 바로 위에선 접힌 성분과 겹쳐 맞춤이 안 되므로 22 kHz에서 잰다
+  ok &= check("22 kHz", 22000, response(22000, &fa), -14.3, -13.8);
+  ok &= check("24 kHz", 24000, response(24000, &fa), at24 - 0.1, at24 + 0.1);
+
+  // 24.1 kHz ~ OSR·FS/2, 접힌 주파수가 0이나 FS/2에 붙으면 맞춤이 안 되므로 뺀다
+  worst = -200;
+  for (double f = 24100; f < OSR * FS / 2; f += STEP) {
+    db = response(f, &fa);
+    if (fa < 200 || fa > FS / 2 - 200) continue;
+    if (db > worst) worst = db, worst_f = f;
+  }
+  ok &= check("stop", worst_f, worst, -200, -63.8);
+  return !ok;
+}
@@ -0,0 +1,121 @@
+// PC에서 record_dsp.c를 돌리는 드라이버. 펌웨어와 같은 소스를 -DOSR=n으로
+// 빌드한다(__ARM_FEATURE_DSP가 없으므로 SMLAD/SSAT는 C 구현).
+//
+//   dsp_test dump <파일>  : 입력 ADC 코드와 출력을 파일로 → dsp_ref.py가 비교
+//   dsp_test bench        : 샘플당 처리 시간(호스트 ns). 타깃 사이클은
+//                           rec_stats.dsp_cycles로 잰다
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "record_dsp.h"
+
+#define FS 44096
+#define BLOCK 256                // record.h의 FRAME_NSAMP
+#define NOUT (BLOCK * 172)       // 약 1초
+#define BENCH_ROUNDS 20
+
+static const int32_t gains[] = {DSP_GAIN_Q12, 16384};  // ×0.5, ×4(리미터 포화)
+#define NGAIN (sizeof(gains) / sizeof(gains[0]))
+
+static uint16_t adc[NOUT * OSR];
+static int16_t q15[NOUT];
+static int16_t out[NGAIN][NOUT];
+
+// 결정적인 테스트 입력: 997 Hz + 5 kHz + DC 오프셋 + 잡음, 중간에 0/4095로
+// 붙는 클리핑 구간을 넣어 SSAT와 리미터 끝까지 지나가게 한다
+static void make_input(void) {
+  uint32_t seed = 1;
+
+  for (uint32_t i = 0; i < NOUT * OSR; i++) {
+    double t = (double)i / (FS * OSR);
+    double v = 2048 + 150 + 1500 * sin(2 * M_PI * 997 * t) +
+               350 * sin(2 * M_PI * 5000 * t);
+    long q;
+
+    seed = seed * 1103515245u + 12345u;
+    v += (int32_t)((seed >> 16) & 63) - 32;
+    if (i / (FS * OSR / 8) == 5) v *= 1.6;  // 5/8초 부근: 클리핑
+    q = lround(v);
+    if (q < 0) q = 0;
+    if (q > 4095) q = 4095;
+    adc[i] = (uint16_t)q;
+  }
+}
+
+// record.c와 같은 호출 순서: 블록마다 데시메이션, 그 결과를 제자리 가공
+static void run(void) {
+  for (uint32_t i = 0; i < NOUT; i += BLOCK) {
+    dsp_adc_to_q15(&q15[i], &adc[i * OSR], BLOCK);
+  }
+  for (uint32_t g = 0; g < NGAIN; g++) {
+    dsp_state_t st;
+
+    dsp_init(&st, gains[g]);
+    memcpy(out[g], q15, sizeof(q15));
+    for (uint32_t i = 0; i < NOUT; i += BLOCK) {
+      dsp_process_block(&st, &out[g][i], &out[g][i], BLOCK);
+    }
+  }
+}
+
+static int dump(const char* path) {
+  FILE* f = fopen(path, "wb");
+  uint32_t hdr[4] = {OSR, NOUT, NGAIN, BLOCK};
+
+  if (!f) {
+    perror(path);
+    return 1;
+  }
+  run();
+  fwrite("RDSP", 1, 4, f);
+  fwrite(hdr, sizeof(hdr), 1, f);
+  fwrite(gains, sizeof(gains), 1, f);
+  fwrite(adc, sizeof(adc), 1, f);
+  fwrite(q15, sizeof(q15), 1, f);
+  fwrite(out, sizeof(out), 1, f);
+  return fclose(f) != 0;
+}
+
+static double now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int bench(void) {
+  dsp_state_t st;
+  double t0, t_dec, t_proc;
+
+  dsp_init(&st, DSP_GAIN_Q12);
+  t0 = now_ns();
+  for (int r = 0; r < BENCH_ROUNDS; r++) {
+    for (uint32_t i = 0; i < NOUT; i += BLOCK) {
+      dsp_adc_to_q15(&q15[i], &adc[i * OSR], BLOCK);
+    }
+  }
+  t_dec = now_ns() - t0;
+  t0 = now_ns();
+  for (int r = 0; r < BENCH_ROUNDS; r++) {
+    for (uint32_t i = 0; i < NOUT; i += BLOCK) {
+      dsp_process_block(&st, &out[0][i], &q15[i], BLOCK);
+    }
+  }
+  t_proc = now_ns() - t0;
+  printf("OSR %d: dsp_adc_to_q15 %.1f ns/sample, dsp_process_block %.1f "
+         "ns/sample (host)\n",
+         OSR, t_dec / (BENCH_ROUNDS * (double)NOUT),
+         t_proc / (BENCH_ROUNDS * (double)NOUT));
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  make_input();
+  if (argc == 3 && strcmp(argv[1], "dump") == 0) return dump(argv[2]);
+  if (argc == 2 && strcmp(argv[1], "bench") == 0) return bench();
+  fprintf(stderr, "usage: %s dump <file> | bench\n", argv[0]);
+  return 2;
+}
@@ -0,0 +1,260 @@
+#!/usr/bin/env python3
+"""Decode a stream_test capture with record_uart_to_wav.py and check it.
+
+stream_test writes the exact bytes record.c handed to the UART DMA plus the
+samples each ADC block should carry. This script replays the bytes through
+the real host tool (pyserial is replaced by a file reader) and checks that:
+
+  - every frame parses, its CRC matches and seq/timestamp count up
+  - 'A' frames hold the same codes an independent IMA encoder (audioop)
+    produces from the expected samples and the frame's header state
+  - the PCM WAV equals the expected samples (ADPCM: the audioop decode),
+    with blocks the device dropped (overrun) filled with silence
+  - ADPCM only: the IMA-ADPCM WAV decodes back to the PCM WAV
+  - a damaged copy of the stream (torn frame in front, junk with sync
+    bytes between two frames, one corrupted payload byte) still decodes
+    time-aligned: the bad frame is counted as a CRC error and becomes
+    silence, everything else is unchanged
+
+Usage: stream_check.py stream.bin expect.bin
+"""
+import contextlib
+import io
+import os
+import re
+import struct
+import sys
+import tempfile
+import types
+import warnings
+import wave
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                '..', '..', 'uart_tools'))
+import record_uart_to_wav as rec  # noqa: E402
+
+with warnings.catch_warnings():
+    warnings.simplefilter('ignore', DeprecationWarning)
+    import audioop  # noqa: E402  (removed in Python 3.13)
+
+
+class FileSerial:
+    """Just enough of serial.Serial: read() from a byte string.
+
+    The end of the data raises KeyboardInterrupt, which record_to_wav
+    treats like Ctrl-C and finalizes the WAV.
+    """
+
+    data = b''
+
+    def __init__(self, port, baudrate=None, timeout=None):
+        self.pos = 0
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        return False
+
+    def read(self, n):
+        if self.pos >= len(self.data):
+            raise KeyboardInterrupt
+        chunk = self.data[self.pos:self.pos + n]
+        self.pos += n
+        return chunk
+
+
+def load_expect(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    if data[:4] != b'RSTR':
+        raise ValueError("not a stream_test expect file")
+    fs, nsamp, nblocks, adpcm, ndrops = struct.unpack_from('<5I', data, 4)
+    pos = 24
+    drops = set(struct.unpack_from(f'<{ndrops}I', data, pos))
+    pos += 4 * ndrops
+    pcm = struct.unpack_from(f'<{nblocks * nsamp}h', data, pos)
+    blocks = [pcm[b * nsamp:(b + 1) * nsamp] for b in range(nblocks)]
+    return fs, nsamp, bool(adpcm), drops, blocks
+
+
+def swap_nibbles(b):
+    # audioop packs the first sample in the high nibble, the device in the low
+    return bytes(((x & 0x0F) << 4) | (x >> 4) for x in b)
+
+
+def split_frames(data):
+    """Walk a clean stream frame by frame: (offset, kind, N, seq, ts, payload)."""
+    frames = []
+    pos = 0
+    while pos < len(data):
+        if data[pos:pos + 2] != rec.SYNC or data[pos + 3:pos + 4] != b'2':
+            raise ValueError(f"no v2 frame at offset {pos}")
+        kind = data[pos + 2:pos + 3]
+        n, seq, ts = struct.unpack_from('<HHI', data, pos + 4)
+        size = 2 * n if kind == b'S' else rec.ADPCM_HEADER_SIZE + n // 2
+        body = data[pos + 4:pos + 12 + size]
+        (crc,) = struct.unpack_from('<I', data, pos + 12 + size)
+        if rec.crc32_stm32(body) != crc:
+            raise ValueError(f"CRC mismatch in frame at offset {pos}")
+        frames.append((pos, kind, n, seq, ts, body[8:]))
+        pos += 12 + size + rec.CRC_SIZE
+    return frames
+
+
+def check_frames(frames, nsamp, adpcm, drops, blocks):
+    """Return the samples each received block decodes to, keyed by block."""
+    decoded = {}
+    sent = [b for b in range(len(blocks)) if b not in drops]
+    if [f[4] // nsamp for f in frames] != sent:
+        raise ValueError("frame timestamps do not match the blocks sent")
+    for (pos, kind, n, seq, ts, payload), b in zip(frames, sent):
+        if seq != b & 0xFFFF or ts != b * nsamp or n != nsamp:
+            raise ValueError(f"bad header in frame at offset {pos}")
+        if kind != (b'A' if adpcm else b'S'):
+            raise ValueError(f"unexpected frame type {kind!r}")
+        if kind == b'S':
+            decoded[b] = struct.unpack(f'<{n}h', payload)
+            continue
+        pred, idx, _ = struct.unpack_from('<hBB', payload)
+        codes = payload[rec.ADPCM_HEADER_SIZE:]
+        ref, _ = audioop.lin2adpcm(struct.pack(f'<{n}h', *blocks[b]), 2, (pred, idx))
+        if swap_nibbles(ref) != codes:
+            raise ValueError(f"ADPCM codes differ from audioop in block {b}")
+        pcm, _ = audioop.adpcm2lin(ref, 2, (pred, idx))
+        mine, _ = rec.ima_decode(codes, n, pred, idx)
+        if list(struct.unpack(f'<{n}h', pcm)) != mine:
+            raise ValueError(f"ima_decode differs from audioop in block {b}")
+        decoded[b] = tuple(mine)
+    return decoded
+
+
+def run_tool(data, fs, out_format, outfile):
+    """Run record_to_wav over the captured bytes; return its printed report."""
+    FileSerial.data = data
+    rec.serial = types.SimpleNamespace(Serial=FileSerial)
+    report = io.StringIO()
+    with contextlib.redirect_stdout(report):
+        rec.record_to_wav('stream', 921600, 0, fs, outfile, out_format=out_format)
+    return report.getvalue()
+
+
+def report_stats(report):
+    """(received, dropped, crc errors) from the tool's end-of-capture report."""
+    m = re.search(r'Frames: (\d+) received, (\d+) dropped', report)
+    c = re.search(r'CRC errors: (\d+)', report)
+    return int(m.group(1)), int(m.group(2)), int(c.group(1))
+
+
+def damage(data, frames):
+    """Return (damaged stream, block whose frame no longer passes CRC)."""
+    k = len(frames) // 3
+    bad = len(frames) * 2 // 3
+    torn = data[frames[0][0] + 40:frames[1][0]]     # capture starts mid-frame
+    junk = b'\x00\x55\xAA\x55\xAA\x13\x55'          # sync bytes, no valid MAGIC
+    out = bytearray(torn + data[:frames[k][0]] + junk + data[frames[k][0]:])
+    out[len(torn) + len(junk) + frames[bad][0] + 12 + 7] ^= 0x40
+    return bytes(out), frames[bad][4] // frames[bad][2]
+
+
+def read_pcm_wav(path):
+    with wave.open(path, 'rb') as w:
+        raw = w.readframes(w.getnframes())
+    return list(struct.unpack(f'<{len(raw) // 2}h', raw))
+
+
+def read_ima_wav(path):
+    """Decode a mono IMA-ADPCM WAV with audioop; return (samples, samples/block)."""
+    with open(path, 'rb') as f:
+        data = f.read()
+    pos = 12
+    chunks = {}
+    while pos < len(data):
+        cid, size = data[pos:pos + 4], struct.unpack_from('<I', data, pos + 4)[0]
+        chunks[cid] = data[pos + 8:pos + 8 + size]
+        pos += 8 + size
+    tag, _, _, _, align, _, _, spb = struct.unpack('<HHIIHHHH', chunks[b'fmt '])
+    (total,) = struct.unpack('<I', chunks[b'fact'])
+    if tag != 0x0011:
+        raise ValueError("not an IMA-ADPCM WAV")
+    out = []
+    body = chunks[b'data']
+    for i in range(0, len(body), align):
+        blk = body[i:i + align]
+        pred, idx, _ = struct.unpack_from('<hBB', blk)
+        pcm, _ = audioop.adpcm2lin(swap_nibbles(blk[4:]), 2, (pred, idx))
+        out.append(pred)
+        out.extend(struct.unpack(f'<{len(pcm) // 2}h', pcm)[:spb - 1])
+    return out[:total], spb
+
+
+def main():
+    if len(sys.argv) != 3:
+        print(f"usage: {sys.argv[0]} stream.bin expect.bin", file=sys.stderr)
+        sys.exit(2)
+    with open(sys.argv[1], 'rb') as f:
+        data = f.read()
+    fs, nsamp, adpcm, drops, blocks = load_expect(sys.argv[2])
+    name = 'ADPCM' if adpcm else 'PCM'
+
+    try:
+        frames = split_frames(data)
+        decoded = check_frames(frames, nsamp, adpcm, drops, blocks)
+        print(f"{name}: {len(frames)} frames, CRC/seq/timestamp ok")
+
+        want = []
+        for b in range(len(blocks)):
+            want.extend(decoded.get(b, (0,) * nsamp))
+        if not adpcm:
+            sent = [v for b, blk in enumerate(blocks)
+                    for v in (blk if b not in drops else (0,) * nsamp)]
+            if want != sent:
+                raise ValueError("PCM payload differs from the ADC blocks")
+        if drops:
+            print(f"{name}: device dropped blocks {sorted(drops)}")
+
+        with tempfile.TemporaryDirectory() as tmp:
+            pcm_wav = os.path.join(tmp, 'pcm.wav')
+            report = run_tool(data, fs, 'pcm', pcm_wav)
+            got = read_pcm_wav(pcm_wav)
+            if got != want:
+                raise ValueError("PCM WAV differs from the expected samples")
+            print(f"{name}: PCM WAV matches ({len(got)} samples)")
+            print('  ' + '\n  '.join(l for l in report.splitlines() if l.startswith('[=] ')
+                                       and not l.endswith(' written')))
+            if report_stats(report) != (len(frames), len(drops), 0):
+                raise ValueError("report does not match the frames sent")
+
+            bad_data, bad_block = damage(data, frames)
+            bad_wav = os.path.join(tmp, 'bad.wav')
+            report = run_tool(bad_data, fs, 'pcm', bad_wav)
+            lo, hi = bad_block * nsamp, (bad_block + 1) * nsamp
+            if read_pcm_wav(bad_wav) != want[:lo] + [0] * nsamp + want[hi:]:
+                raise ValueError("damaged stream did not decode time-aligned")
+            if report_stats(report) != (len(frames) - 1, len(drops) + 1, 1):
+                raise ValueError("damaged stream: wrong drop/CRC statistics")
+            print(f"{name}: damaged stream resyncs, block {bad_block} -> CRC error + silence")
+
+            if adpcm:
+                ima_wav = os.path.join(tmp, 'ima.wav')
+                run_tool(data, fs, 'ima', ima_wav)
+                ima, spb = read_ima_wav(ima_wav)
+                if len(ima) != len(got):
+                    raise ValueError("IMA WAV has the wrong length")
+                # only IMA blocks that span a silence gap are re-quantized
+                requant = 0
+                for start in range(0, len(got), spb):
+                    end = min(start + spb, len(got))
+                    if any(start < (b + 1) * nsamp and b * nsamp < end for b in drops):
+                        requant += 1
+                    elif ima[start:end] != got[start:end]:
+                        raise ValueError(f"IMA WAV block at sample {start} differs")
+                print(f"{name}: IMA-ADPCM WAV decodes to the PCM WAV "
+                      f"({requant} block(s) around gaps re-quantized)")
+    except ValueError as e:
+        print(f"{name}: FAIL: {e}")
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,161 @@
+// PC에서 record.c의 프레임 송출을 돌리는 드라이버. main.c의 루프처럼 하프버퍼
+// 콜백 → uart_frame_begin → process_block_to_pcm → uart_frame_commit 순서로
+// 블록을 넣고, UART DMA가 보낸 바이트를 파일로 남긴다. stream_check.py가 이
+// 스트림을 record_uart_to_wav.py로 풀어서 기대값과 비교한다.
+//  - STALL_AT부터 STALL_LEN블록 동안 DMA 완료가 안 온다 → 두 버퍼가 다 차서
+//    블록이 버려진다(overrun). 버린 블록 번호를 기대값 파일에 적는다
+//  - LATE_AT 블록은 두 하프 콜백이 루프보다 먼저 온다 → 각자 번호를 가져야 함
+//
+//   stream_test <스트림 파일> <기대값 파일>
+//
+// 기대값은 (code - 2048) << 3이라 RAW_MODE 1, OSR 1로만 빌드한다.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "record.h"
+
+#if !RAW_MODE || OSR != 1
+#error "stream_test는 RAW_MODE 1, OSR 1 전용입니다."
+#endif
+
+#define NBLOCKS 400  // 약 2.3초
+#define STALL_AT 100
+#define STALL_LEN 5
+#define LATE_AT 200  // 짝수(하프 #0부터)
+
+UART_HandleTypeDef huart2;
+CRC_HandleTypeDef hcrc;
+DWT_Type host_dwt;
+CoreDebug_Type host_core_debug;
+
+static FILE* stream;
+static const uint8_t* dma_buf;  // DMA가 보내는 중인 프레임(끝날 때 읽는다)
+static uint16_t dma_len;
+static int16_t expect[NBLOCKS][FRAME_NSAMP];
+static uint32_t drops[NBLOCKS], ndrops;
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef* huart,
+                                        const uint8_t* pData, uint16_t Size) {
+  (void)huart;
+  if (dma_buf) return HAL_BUSY;
+  dma_buf = pData;
+  dma_len = Size;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef* huart,
+                                    const uint8_t* pData, uint16_t Size,
+                                    uint32_t Timeout) {
+  (void)huart;
+  (void)Timeout;
+  fwrite(pData, 1, Size, stream);
+  return HAL_OK;
+}
+
+// F4 CRC 주변장치: CRC-32/MPEG-2, 초기값 0xFFFFFFFF, 워드를 MSB부터
+uint32_t HAL_CRC_Calculate(CRC_HandleTypeDef* h, uint32_t pBuffer[],
+                           uint32_t BufferLength) {
+  uint32_t crc = 0xFFFFFFFFu;
+
+  (void)h;
+  for (uint32_t i = 0; i < BufferLength; i++) {
+    crc ^= pBuffer[i];
+    for (int b = 0; b < 32; b++) {
+      crc = (crc & 0x80000000u) ? (crc << 1) ^ 0x04C11DB7u : crc << 1;
+    }
+  }
+  return crc;
+}
+
+// 전송 완료 인터럽트. 바이트는 이 시점의 버퍼 내용으로 남긴다(전송 중에
+// record.c가 버퍼를 덮어쓰면 스트림이 깨져 드러난다)
+static void dma_complete(void) {
+  fwrite(dma_buf, 1, dma_len, stream);
+  dma_buf = NULL;
+  uart_tx_cplt_callback();
+}
+
+// 블록 b의 ADC 코드: 997 Hz + 7 kHz, 0..4095를 거의 다 쓴다
+static void fill_half(uint16_t* half, uint32_t b) {
+  for (uint32_t i = 0; i < FRAME_NSAMP; i++) {
+    double t = (double)(b * FRAME_NSAMP + i) / FS;
+    long q = lround(2048 + 1700 * sin(2 * M_PI * 997 * t) +
+                    300 * sin(2 * M_PI * 7000 * t));
+
+    half[i] = (uint16_t)q;
+    expect[b][i] = (int16_t)((q - 2048) << 3);
+  }
+}
+
+// main.c의 ADC 콜백: 하프버퍼가 찼고 그 블록 번호를 저장
+static uint32_t half_block[2];
+
+static void adc_callback(uint32_t b) {
+  fill_half(&adc_buf[(b & 1) * (BUF_LEN / 2)], b);
+  half_block[b & 1] = rec_adc_block_done();
+}
+
+// main.c의 half_ready/full_ready 처리 한 번
+static void run_block(uint32_t b) {
+  const uint16_t* src = &adc_buf[(b & 1) * (BUF_LEN / 2)];
+  uint32_t block = half_block[b & 1];
+  int16_t* pcm;
+
+  rec_block_begin();
+  pcm = uart_frame_begin(block);
+  if (pcm) {
+    uart_frame_commit(process_block_to_pcm(pcm, src, FRAME_NSAMP));
+  } else {
+    drops[ndrops++] = block;
+  }
+  rec_block_end();
+}
+
+static int write_expect(const char* path) {
+  FILE* f = fopen(path, "wb");
+  uint32_t hdr[5] = {FS, FRAME_NSAMP, NBLOCKS, UART_ADPCM, ndrops};
+
+  if (!f) {
+    perror(path);
+    return 1;
+  }
+  fwrite("RSTR", 1, 4, f);
+  fwrite(hdr, sizeof(hdr), 1, f);
+  fwrite(drops, sizeof(drops[0]), ndrops, f);
+  fwrite(expect, sizeof(expect), 1, f);
+  return fclose(f) != 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 3) {
+    fprintf(stderr, "usage: %s <stream> <expect>\n", argv[0]);
+    return 2;
+  }
+  stream = fopen(argv[1], "wb");
+  if (!stream) {
+    perror(argv[1]);
+    return 1;
+  }
+  rec_stats_init();
+  for (uint32_t b = 0; b < NBLOCKS; b++) {
+    if (b == LATE_AT) {
+      adc_callback(b);
+      adc_callback(b + 1);
+      run_block(b);
+      run_block(++b);
+    } else {
+      adc_callback(b);
+      run_block(b);
+    }
+    if (b >= STALL_AT && b < STALL_AT + STALL_LEN) continue;
+    while (dma_buf) dma_complete();
+  }
+  while (dma_buf) dma_complete();
+  fclose(stream);
+  printf("stream_test(%s): %lu frames, %lu overruns\n",
+         UART_ADPCM ? "ADPCM" : "PCM", (unsigned long)rec_stats.frames,
+         (unsigned long)rec_stats.overruns);
+  return write_expect(argv[2]);
+}
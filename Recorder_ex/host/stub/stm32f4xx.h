@@ -0,0 +1,47 @@
+// PC 빌드용 최소 스텁. record.c가 쓰는 HAL/CMSIS 이름만 있다.
+// 동작은 stream_test.c가 구현한다(UART DMA는 버퍼만 기억, CRC는 비트 단위).
+#ifndef _HOST_STM32F4XX_H_
+#define _HOST_STM32F4XX_H_
+
+#include <stddef.h>  // NULL, 실제 HAL 헤더도 끌어온다
+#include <stdint.h>
+
+typedef enum { HAL_OK = 0, HAL_ERROR, HAL_BUSY, HAL_TIMEOUT } HAL_StatusTypeDef;
+#define HAL_MAX_DELAY 0xFFFFFFFFU
+
+typedef struct {
+  int id;
+} UART_HandleTypeDef;
+
+typedef struct {
+  int id;
+} CRC_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef* huart,
+                                        const uint8_t* pData, uint16_t Size);
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef* huart,
+                                    const uint8_t* pData, uint16_t Size,
+                                    uint32_t Timeout);
+uint32_t HAL_CRC_Calculate(CRC_HandleTypeDef* hcrc, uint32_t pBuffer[],
+                           uint32_t BufferLength);
+
+typedef struct {
+  volatile uint32_t CTRL;
+  volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+  volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+extern DWT_Type host_dwt;
+extern CoreDebug_Type host_core_debug;
+#define DWT (&host_dwt)
+#define CoreDebug (&host_core_debug)
+#define DWT_CTRL_CYCCNTENA_Msk 1U
+#define CoreDebug_DEMCR_TRCENA_Msk (1U << 24)
+
+static inline void __disable_irq(void) {}
+static inline void __enable_irq(void) {}
+
+#endif
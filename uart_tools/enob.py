@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+"""Estimate SINAD / ENOB of a recorded sine tone (IEEE 1057 3-parameter fit).
+
+Feed a clean sine of known frequency into the recorder ADC input, capture it
+with record_uart_to_wav.py, then run:
+
+    python enob.py capture.wav --tone 1000
+
+Everything the fitted sine does not explain (noise, distortion, spurs) counts
+as error, so the result is SINAD-based ENOB = (SINAD - 1.76) / 6.02.
+ENOB is reported relative to the recording's full scale (int16) and, with
+--full-scale, relative to another amplitude. In RAW_MODE 1 the ADC span maps
+to +-16384 ((code - 2048) << 3), so use --full-scale 16384 to get the ADC ENOB.
+"""
+import argparse
+import math
+import struct
+import sys
+import wave
+
+
+def read_wav(path):
+    with wave.open(path, 'rb') as w:
+        if w.getsampwidth() != 2 or w.getnchannels() != 1:
+            raise ValueError("expected 16-bit mono WAV")
+        fs = w.getframerate()
+        raw = w.readframes(w.getnframes())
+    n = len(raw) // 2
+    return fs, list(struct.unpack('<%dh' % n, raw[:2 * n]))
+
+
+def solve3(m, v):
+    """Solve a 3x3 linear system (Gaussian elimination with pivoting)."""
+    a = [row[:] + [v[i]] for i, row in enumerate(m)]
+    for c in range(3):
+        p = max(range(c, 3), key=lambda r: abs(a[r][c]))
+        a[c], a[p] = a[p], a[c]
+        for r in range(3):
+            if r != c:
+                f = a[r][c] / a[c][c]
+                for k in range(c, 4):
+                    a[r][k] -= f * a[c][k]
+    return [a[i][3] / a[i][i] for i in range(3)]
+
+
+def sine_fit(x, fs, tone):
+    """Least-squares fit of A*cos + B*sin + C at a known frequency."""
+    w = 2 * math.pi * tone / fs
+    m = [[0.0] * 3 for _ in range(3)]
+    v = [0.0] * 3
+    for n, s in enumerate(x):
+        b = (math.cos(w * n), math.sin(w * n), 1.0)
+        for i in range(3):
+            v[i] += b[i] * s
+            for j in range(3):
+                m[i][j] += b[i] * b[j]
+    a, b, c = solve3(m, v)
+    err = 0.0
+    for n, s in enumerate(x):
+        e = s - (a * math.cos(w * n) + b * math.sin(w * n) + c)
+        err += e * e
+    return math.hypot(a, b), c, math.sqrt(err / len(x))
+
+
+def enob(x, fs, tone, full_scale=32768.0):
+    amp, dc, rms_err = sine_fit(x, fs, tone)
+    sinad = 20 * math.log10((amp / math.sqrt(2)) / rms_err)
+    # Refer the result to a full-scale sine instead of the test amplitude
+    enob_fs = (sinad - 1.76 + 20 * math.log10(full_scale / amp)) / 6.02
+    return amp, dc, sinad, enob_fs
+
+
+def main():
+    p = argparse.ArgumentParser(description="SINAD/ENOB of a recorded sine tone")
+    p.add_argument("wav", help="16-bit mono WAV from record_uart_to_wav.py")
+    p.add_argument("--tone", type=float, required=True, help="Test tone frequency (Hz)")
+    p.add_argument("--skip", type=float, default=0.1, help="Seconds to skip at the start (default: 0.1)")
+    p.add_argument("--seconds", type=float, default=1.0, help="Seconds to analyze (default: 1.0)")
+    p.add_argument("--full-scale", type=float, default=32768.0,
+                   help="Full-scale amplitude for ENOB (default: 32768)")
+    args = p.parse_args()
+
+    try:
+        fs, x = read_wav(args.wav)
+    except Exception as e:
+        print(f"Error: {e}", file=sys.stderr)
+        sys.exit(2)
+    start = int(args.skip * fs)
+    x = x[start:start + int(args.seconds * fs)]
+    if len(x) < fs // 10:
+        print("Error: not enough samples", file=sys.stderr)
+        sys.exit(2)
+
+    amp, dc, sinad, bits = enob(x, fs, args.tone, args.full_scale)
+    print(f"fs={fs} Hz  N={len(x)}  tone={args.tone:g} Hz")
+    print(f"amplitude={amp:.1f}  dc={dc:.1f}  SINAD={sinad:.2f} dB  ENOB={bits:.2f} bits")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+import argparse
+import struct
+import sys
+import time
+
+try:
+    import serial  # pip install pyserial
+except Exception as e:
+    serial = None
+
+MAGIC = b'\x55\xAAT1'  # 0x55 0xAA 'T' '1'
+# tick, periodMs, hdat0, hdat1, decodeTime, sampleRate, bitrateKbps, sdiBytesPerSec,
+# underruns, refills, stallUs, sciWaitUs, idlePermille, ringLow, ringHigh, readMaxUs, readHist[8],
+# checksum
+BODY = struct.Struct('<IHHHHHHIIIIIHHHI8HB')
+HIST_LABELS = ['<256us', '<512us', '<1ms', '<2ms', '<4ms', '<8ms', '<16ms', '>=16ms']
+
+def describe_format(hdat1):
+    """HDAT1 -> stream format name (VS1053 datasheet, SCI_HDAT1)."""
+    if hdat1 >= 0xFFE0:
+        return 'MP3'
+    names = {0x7665: 'WAV', 0x4154: 'AAC ADTS', 0x4144: 'AAC ADIF', 0x4D34: 'AAC MP4',
+             0x574D: 'WMA', 0x4F67: 'Ogg', 0x664C: 'FLAC', 0x4D54: 'MIDI'}
+    return names.get(hdat1, 'idle' if hdat1 == 0 else f'0x{hdat1:04X}')
+
+def read_frame(ser):
+    """Scan for MAGIC, return the unpacked body or None on checksum error."""
+    buf = bytearray()
+    while True:
+        b = ser.read(1)
+        if not b:
+            continue
+        buf += b
+        if len(buf) > 4:
+            del buf[:-4]
+        if bytes(buf) != MAGIC:
+            continue
+        ln = ser.read(2)
+        if len(ln) < 2:
+            return None
+        (n,) = struct.unpack('<H', ln)
+        body = ser.read(n)
+        if n != BODY.size or len(body) != n:
+            return None
+        if sum(body[:-1]) & 0xFF != body[-1]:
+            return None
+        return BODY.unpack(body)
+
+def main():
+    parser = argparse.ArgumentParser(description="MP3 player telemetry (USART2, 'T1' frames)")
+    parser.add_argument('-p', '--port', default='/dev/ttyUSB0')
+    parser.add_argument('-b', '--baud', type=int, default=115200)
+    parser.add_argument('--csv', help="also append every frame to this CSV file")
+    args = parser.parse_args()
+
+    if serial is None:
+        print("pyserial is not installed. Install with: pip install pyserial", file=sys.stderr)
+        sys.exit(1)
+
+    csv = open(args.csv, 'a') if args.csv else None
+    with serial.Serial(args.port, baudrate=args.baud, timeout=1) as ser:
+        ser.write(b't')  # telemetry on
+        print(f"[+] Opened {args.port} at {args.baud} bps, waiting for frames (MAGIC=55 AA 54 31)...")
+        try:
+            while True:
+                f = read_frame(ser)
+                if f is None:
+                    print("[!] bad frame")
+                    continue
+                (tick, period, hdat0, hdat1, dtime, rate, kbps, sdi, under, refills,
+                 stall, sciwait, idle, low, high, readmax) = f[:16]
+                hist = f[16:24]
+                print(f"{tick / 1000:9.1f}s {describe_format(hdat1):8} {kbps:4} kbps {rate:5} Hz "
+                      f"t={dtime:4}s sdi={sdi:6} B/s under={under} refills={refills} "
+                      f"stall={stall / period / 10:5.1f}% sciwait={sciwait}us idle={idle / 10:5.1f}% "
+                      f"ring={low}..{high} read max={readmax}us")
+                print("           read " + ' '.join(f"{l}:{c}" for l, c in zip(HIST_LABELS, hist)))
+                if csv:
+                    csv.write(','.join(str(v) for v in f[:-1]) + '\n')
+                    csv.flush()
+        except KeyboardInterrupt:
+            ser.write(b't')  # telemetry off
+        finally:
+            if csv:
+                csv.close()
+
+if __name__ == '__main__':
+    main()
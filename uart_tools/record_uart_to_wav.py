@@ -1,5 +1,6 @@
 #!/usr/bin/env python3
 import argparse
+import collections
 import struct
 import wave
 import sys
@@ -10,11 +11,143 @@ try:
 except Exception as e:
     serial = None
 
-MAGIC = b'\x55\xAAS1'  # 0x55 0xAA 'S' '1'
-HEADER_SIZE = 6        # 4-byte MAGIC + uint16 little-endian sample count
+SYNC = b'\x55\xAA'
+# Frame = SYNC + type ('S' PCM16 LE / 'A' IMA-ADPCM 4:1) + version
+#  v1: MAGIC + N(LE16) + payload
+#  v2: MAGIC + N(LE16) + seq(LE16) + timestamp in samples (LE32) + payload
+#      + CRC-32 (LE32) over N..payload, as computed by the STM32 CRC unit
+FRAME_TYPES = (b'S', b'A')
+FRAME_VERSIONS = (b'1', b'2')
+HEADER_SIZE = 6             # 4-byte MAGIC + uint16 little-endian sample count
+V2_EXTRA_SIZE = 6           # seq16 + timestamp32
+CRC_SIZE = 4
+ADPCM_HEADER_SIZE = 4       # int16 predictor + uint8 step index + pad
+MAX_GAP_SECONDS = 10.0      # larger jumps are treated as a device restart
 
-def find_sync_and_len(ser, timeout=5.0):
-    """Scan the serial stream until a MAGIC header is found; return payload length (samples)."""
+# pcm: PCM16 LE bytes; indices: ADPCM step index per sample (or None);
+# seq/ts: None for v1 frames
+Frame = collections.namedtuple('Frame', 'pcm indices seq ts')
+
+
+def _crc32_stm32_table():
+    table = []
+    for i in range(256):
+        c = i << 24
+        for _ in range(8):
+            c = ((c << 1) ^ 0x04C11DB7) if c & 0x80000000 else (c << 1)
+        table.append(c & 0xFFFFFFFF)
+    return table
+
+CRC_TABLE = _crc32_stm32_table()
+
+def crc32_stm32(data):
+    """CRC-32/MPEG-2 as the STM32F4 CRC unit computes it over LE 32-bit words.
+
+    The unit shifts each word in MSB first, so the bytes of every
+    little-endian word are fed in reverse order.
+    """
+    crc = 0xFFFFFFFF
+    for i in range(0, len(data), 4):
+        for b in reversed(data[i:i + 4]):
+            crc = ((crc << 8) & 0xFFFFFFFF) ^ CRC_TABLE[((crc >> 24) ^ b) & 0xFF]
+    return crc
+
+# Standard IMA/DVI ADPCM tables (same as record_dsp.c)
+IMA_STEP = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+    11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767,
+]
+IMA_INDEX = [-1, -1, -1, -1, 2, 4, 6, 8]
+
+def ima_step_code(code, pred, idx):
+    """Apply one 4-bit code to (predictor, index); return the new state."""
+    step = IMA_STEP[idx]
+    vpdiff = step >> 3
+    if code & 4:
+        vpdiff += step
+    if code & 2:
+        vpdiff += step >> 1
+    if code & 1:
+        vpdiff += step >> 2
+    pred = pred - vpdiff if code & 8 else pred + vpdiff
+    pred = max(-32768, min(32767, pred))
+    idx = max(0, min(88, idx + IMA_INDEX[code & 7]))
+    return pred, idx
+
+def ima_decode(data, N, pred, idx):
+    """Decode N samples (low nibble first) starting from the given state.
+
+    Returns (samples, indices); indices[i] is the step index after sample i.
+    """
+    out = []
+    indices = []
+    for i in range(N):
+        code = (data[i >> 1] >> (4 * (i & 1))) & 0x0F
+        pred, idx = ima_step_code(code, pred, idx)
+        out.append(pred)
+        indices.append(idx)
+    return out, indices
+
+def ima_encode_sample(x, pred, idx):
+    """Encode one sample; return (code, new predictor, new index)."""
+    step = IMA_STEP[idx]
+    diff = x - pred
+    code = 0
+    if diff < 0:
+        code = 8
+        diff = -diff
+    if diff >= step:
+        code |= 4
+        diff -= step
+    if diff >= step >> 1:
+        code |= 2
+        diff -= step >> 1
+    if diff >= step >> 2:
+        code |= 1
+    pred, idx = ima_step_code(code, pred, idx)
+    return code, pred, idx
+
+def write_ima_wav(outfile, samples, fs, indices=None, block_align=1024):
+    """Write mono samples as a Microsoft IMA-ADPCM WAV (format tag 0x0011).
+
+    Samples decoded from 'A1' frames are exactly reachable by the IMA
+    quantizer, so re-encoding them from the device's step index (indices,
+    as returned by ima_decode) reproduces the device's codes. Only a block
+    that spans a dropped frame is re-quantized.
+    """
+    spb = (block_align - 4) * 2 + 1
+    blocks = bytearray()
+    idx = 0
+    for start in range(0, len(samples), spb):
+        chunk = samples[start:start + spb]
+        pred = chunk[0]
+        if indices is not None:
+            idx = indices[start]
+        blk = bytearray(struct.pack('<hBB', pred, idx, 0))
+        codes = []
+        for x in chunk[1:]:
+            code, pred, idx = ima_encode_sample(x, pred, idx)
+            codes.append(code)
+        codes += [0] * (2 * (block_align - 4) - len(codes))
+        for i in range(0, len(codes), 2):
+            blk.append(codes[i] | (codes[i + 1] << 4))
+        blocks += blk
+    fmt = struct.pack('<HHIIHHHH', 0x0011, 1, fs, fs * block_align // spb,
+                      block_align, 4, 2, spb)
+    fact = struct.pack('<I', len(samples))
+    body = (b'WAVE' + b'fmt ' + struct.pack('<I', len(fmt)) + fmt +
+            b'fact' + struct.pack('<I', len(fact)) + fact +
+            b'data' + struct.pack('<I', len(blocks)) + bytes(blocks))
+    with open(outfile, 'wb') as f:
+        f.write(b'RIFF' + struct.pack('<I', len(body)) + body)
+
+def find_sync(ser, timeout=5.0):
+    """Scan the serial stream until a frame MAGIC is found; return it."""
     deadline = time.time() + timeout
     buf = bytearray()
     while time.time() < deadline:
@@ -24,17 +157,52 @@ def find_sync_and_len(ser, timeout=5.0):
         buf += b
         if len(buf) > 4:
             del buf[:-4]
-        if bytes(buf) == MAGIC:
-            ln = ser.read(2)
-            if len(ln) < 2:
-                # try again
-                buf.clear()
-                continue
-            (N,) = struct.unpack('<H', ln)
-            return N
+        if (len(buf) == 4 and buf[:2] == SYNC and bytes(buf[2:3]) in FRAME_TYPES
+                and bytes(buf[3:4]) in FRAME_VERSIONS):
+            return bytes(buf)
     raise TimeoutError("Sync not found within timeout. Check wiring/baud/MAGIC.")
 
-def record_to_wav(port, baud, seconds, fs, outfile, samples_per_frame_hint=256, verbose=True):
+def read_frame(ser, stats):
+    """Read one frame (PCM or ADPCM, v1 or v2).
+
+    Returns a Frame, or None on a short read / bad CRC (counted in stats).
+    """
+    magic = find_sync(ser, timeout=5.0)
+    kind, version = magic[2:3], magic[3:4]
+    head_size = 2 + (V2_EXTRA_SIZE if version == b'2' else 0)
+    head = ser.read(head_size)
+    if len(head) != head_size:
+        stats['short'] += 1
+        return None
+    (N,) = struct.unpack('<H', head[:2])
+    size = N * 2 if kind == b'S' else ADPCM_HEADER_SIZE + (N + 1) // 2
+    if version == b'2':
+        size += CRC_SIZE
+    payload = ser.read(size)
+    if len(payload) != size:
+        stats['short'] += 1
+        return None
+
+    seq = ts = None
+    if version == b'2':
+        seq, ts = struct.unpack('<HI', head[2:])
+        (crc,) = struct.unpack('<I', payload[-CRC_SIZE:])
+        payload = payload[:-CRC_SIZE]
+        if crc32_stm32(head + payload) != crc:
+            stats['crc'] += 1
+            return None
+
+    if kind == b'S':
+        return Frame(payload, None, seq, ts)
+    pred, idx, _ = struct.unpack('<hBB', payload[:ADPCM_HEADER_SIZE])
+    if idx > 88:
+        stats['short'] += 1
+        return None
+    pcm, indices = ima_decode(payload[ADPCM_HEADER_SIZE:], N, pred, idx)
+    return Frame(struct.pack('<%dh' % N, *pcm), indices, seq, ts)
+
+def record_to_wav(port, baud, seconds, fs, outfile, samples_per_frame_hint=256, verbose=True,
+                  out_format='pcm'):
     if serial is None:
         print("pyserial is not installed. Install with: pip install pyserial", file=sys.stderr)
         sys.exit(1)
@@ -42,29 +210,61 @@ def record_to_wav(port, baud, seconds, fs, outfile, samples_per_frame_hint=256,
     total_samples_target = int(seconds * fs) if seconds > 0 else None
     frames_written = 0
 
-    with serial.Serial(port, baudrate=baud, timeout=1) as ser, \
-         wave.open(outfile, 'wb') as wav:
-        wav.setnchannels(1)
-        wav.setsampwidth(2)   # 16-bit PCM
-        wav.setframerate(fs)
+    # PCM streams straight into the WAV; IMA is encoded once at the end
+    wav = None
+    ima_samples = []
+    ima_indices = []
+    stats = {'frames': 0, 'dropped': 0, 'filled': 0, 'crc': 0, 'short': 0, 'restarts': 0}
+    next_ts = None
+
+    def write_samples(pcm, indices):
+        nonlocal ima_indices
+        if wav is not None:
+            wav.writeframesraw(pcm)
+            return
+        ima_samples.extend(struct.unpack('<%dh' % (len(pcm) // 2), pcm))
+        if ima_indices is not None and indices is not None:
+            ima_indices.extend(indices)
+        else:
+            ima_indices = None  # PCM frames: no device state to reuse
+
+    with serial.Serial(port, baudrate=baud, timeout=1) as ser:
+        if out_format == 'pcm':
+            wav = wave.open(outfile, 'wb')
+            wav.setnchannels(1)
+            wav.setsampwidth(2)   # 16-bit PCM
+            wav.setframerate(fs)
 
         if verbose:
             print(f"[+] Opened {port} at {baud} bps, writing {outfile} @ {fs} Hz")
             if total_samples_target:
                 print(f"[+] Target: {seconds} s ({total_samples_target} samples)")
-            print("[+] Waiting for sync (MAGIC=55 AA 53 31)...")
+            print("[+] Waiting for sync (MAGIC=55 AA 'S'/'A' '1'/'2')...")
 
         try:
             while True:
-                N = find_sync_and_len(ser, timeout=5.0)
-                payload_bytes = ser.read(N * 2)
-                if len(payload_bytes) != N * 2:
-                    # resync on short read
+                frame = read_frame(ser, stats)
+                if frame is None:
+                    # short read or bad CRC: resync; a v2 gap is filled on the next frame
                     if verbose:
-                        print("[!] Short read; resyncing...")
+                        print("\n[!] Bad frame; resyncing...")
                     continue
 
-                wav.writeframesraw(payload_bytes)
+                N = len(frame.pcm) // 2
+                if frame.ts is not None:
+                    gap = (frame.ts - next_ts) & 0xFFFFFFFF if next_ts is not None else 0
+                    if 0 < gap <= MAX_GAP_SECONDS * fs:
+                        # keep the recording time-aligned: silence for the missing blocks
+                        write_samples(bytes(2 * gap), [0] * gap)
+                        frames_written += gap
+                        stats['filled'] += gap
+                        stats['dropped'] += (gap + N - 1) // N
+                    elif gap:
+                        stats['restarts'] += 1
+                    next_ts = (frame.ts + N) & 0xFFFFFFFF
+
+                write_samples(frame.pcm, frame.indices)
+                stats['frames'] += 1
                 frames_written += N
 
                 if verbose and frames_written % (fs // 2) < N:
@@ -81,21 +281,37 @@ def record_to_wav(port, baud, seconds, fs, outfile, samples_per_frame_hint=256,
 
         finally:
             # Make sure WAV header is finalized
-            wav.close()
+            if wav is not None:
+                wav.close()
+            else:
+                write_ima_wav(outfile, ima_samples, fs, ima_indices)
             if verbose:
                 print(f"\n[✓] Done. Total samples: {frames_written} (~{frames_written/fs:.2f} s)")
+                print_stats(stats, fs)
+
+def print_stats(stats, fs):
+    """Summarize link quality for the capture."""
+    total = stats['frames'] + stats['dropped']
+    loss = 100.0 * stats['dropped'] / total if total else 0.0
+    print(f"[=] Frames: {stats['frames']} received, {stats['dropped']} dropped ({loss:.2f}%)")
+    print(f"[=] Silence inserted: {stats['filled']} samples (~{stats['filled']/fs:.3f} s)")
+    print(f"[=] CRC errors: {stats['crc']}, short/invalid frames: {stats['short']}, "
+          f"restarts: {stats['restarts']}")
 
 def main():
-    p = argparse.ArgumentParser(description="Record framed PCM from STM32 over UART to WAV")
+    p = argparse.ArgumentParser(description="Record framed PCM/IMA-ADPCM from STM32 over UART to WAV")
     p.add_argument("--port", required=True, help="Serial port (e.g., COM7 or /dev/ttyACM0)")
     p.add_argument("--baud", type=int, default=921600, help="Baud rate (default: 921600)")
     p.add_argument("--seconds", type=float, default=10.0, help="Record duration seconds (<=0 for indefinite)")
     p.add_argument("--fs", type=int, default=16000, help="Sample rate (default: 16000 Hz)")
     p.add_argument("--outfile", default="capture.wav", help="Output WAV filename")
+    p.add_argument("--format", choices=("pcm", "ima"), default="pcm",
+                   help="Output WAV encoding: 16-bit PCM or IMA-ADPCM (default: pcm)")
     args = p.parse_args()
 
     try:
-        record_to_wav(args.port, args.baud, args.seconds, args.fs, args.outfile)
+        record_to_wav(args.port, args.baud, args.seconds, args.fs, args.outfile,
+                      out_format=args.format)
     except Exception as e:
         print(f"Error: {e}", file=sys.stderr)
         sys.exit(2)